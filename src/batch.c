@@ -0,0 +1,337 @@
+/**
+ * @file batch.c
+ * @author Antoine Qiu
+ * @brief Implementation of the batched environment, stepping many agents at once
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "batch.h"
+
+#if defined(__AVX2__) && (defined(QTYPE_DOUBLE) || defined(QTYPE_FLOAT))
+#include <immintrin.h>
+#elif defined(__SSE2__) && (defined(QTYPE_DOUBLE) || defined(QTYPE_FLOAT))
+#include <emmintrin.h>
+#endif
+
+int init_batch(Batch *batch, Map *map, int count)
+{
+    batch->count = count;
+    batch->cells = malloc(count * sizeof(int));
+    batch->actions = malloc(count * sizeof(int));
+    batch->next = malloc(count * sizeof(int));
+    batch->rewards = malloc(count * sizeof(int));
+    batch->draws = malloc(count * sizeof(uint64_t));
+    batch->random = malloc(4 * count * sizeof(uint64_t));
+    batch->epochs = 0;
+    batch->steps = 0;
+    if (batch->cells == NULL || batch->actions == NULL || batch->next == NULL || batch->rewards == NULL || batch->draws == NULL || batch->random == NULL)
+    {
+        free_batch(*batch);
+        return 0;
+    }
+
+    // each agent gets an independent stream of the map generator
+    int start = get_cell(*map, (*map).start);
+    for (int k = 0; k < count; k++)
+    {
+        jump_random(&(*map).random);
+        for (int i = 0; i < 4; i++)
+        {
+            batch->random[i * count + k] = (*map).random.s[i];
+        }
+        batch->cells[k] = start;
+    }
+    jump_random(&(*map).random);
+    return 1;
+}
+
+void free_batch(Batch batch)
+{
+    free(batch.cells);
+    free(batch.actions);
+    free(batch.next);
+    free(batch.rewards);
+    free(batch.draws);
+    free(batch.random);
+}
+
+/**
+ * @brief Draw the next random value of every agent, the same xoshiro256** step applied lane by lane so it vectorizes
+ *
+ * @param batch Batch of agents
+ */
+static void draw_batch(Batch *batch)
+{
+    int count = batch->count;
+    uint64_t *restrict s0 = batch->random;
+    uint64_t *restrict s1 = s0 + count;
+    uint64_t *restrict s2 = s1 + count;
+    uint64_t *restrict s3 = s2 + count;
+    uint64_t *restrict draws = batch->draws;
+    for (int k = 0; k < count; k++)
+    {
+        draws[k] = rotate_left(s1[k] * 5, 7) * 9;
+        uint64_t t = s1[k] << 17;
+        s2[k] ^= s0[k];
+        s3[k] ^= s1[k];
+        s1[k] ^= s2[k];
+        s0[k] ^= s3[k];
+        s2[k] ^= t;
+        s3[k] = rotate_left(s3[k], 45);
+    }
+}
+
+/**
+ * @brief Find the actions with the maximum Q-value among the possible ones
+ *
+ * The stored values are compared directly, the conversion to double keeps their order.
+ *
+ * @param values The 4 Q-values of a cell, aligned on 4 Q-values
+ * @param actions Bitmask of the possible actions
+ * @return int Bitmask of the best actions
+ */
+static inline int best_actions(const QValue *values, int actions)
+{
+#if defined(__SSE2__) && defined(QTYPE_DOUBLE)
+    // lanes of impossible actions are replaced by -inf before the horizontal max
+    static const double lanes[4][2] __attribute__((aligned(16))) = {{0, 0}, {-1, 0}, {0, -1}, {-1, -1}};
+    __m128d minus = _mm_set1_pd(-INFINITY);
+    __m128d low_mask = _mm_cmpneq_pd(_mm_load_pd(lanes[actions & 3]), _mm_setzero_pd());
+    __m128d high_mask = _mm_cmpneq_pd(_mm_load_pd(lanes[actions >> 2]), _mm_setzero_pd());
+    __m128d low = _mm_load_pd(values);
+    __m128d high = _mm_load_pd(values + 2);
+    low = _mm_or_pd(_mm_and_pd(low_mask, low), _mm_andnot_pd(low_mask, minus));
+    high = _mm_or_pd(_mm_and_pd(high_mask, high), _mm_andnot_pd(high_mask, minus));
+    __m128d max = _mm_max_pd(low, high);
+    max = _mm_max_pd(max, _mm_shuffle_pd(max, max, 1));
+    int votes = _mm_movemask_pd(_mm_cmpeq_pd(low, max)) | _mm_movemask_pd(_mm_cmpeq_pd(high, max)) << 2;
+    return votes & actions;
+#elif defined(__SSE2__) && defined(QTYPE_FLOAT)
+    // the 4 float Q-values fit in one register, lanes of impossible actions are replaced by -inf
+    __m128i bits = _mm_and_si128(_mm_set1_epi32(actions), _mm_setr_epi32(1, 2, 4, 8));
+    __m128 mask = _mm_castsi128_ps(_mm_cmpgt_epi32(bits, _mm_setzero_si128()));
+    __m128 all = _mm_load_ps(values);
+    all = _mm_or_ps(_mm_and_ps(mask, all), _mm_andnot_ps(mask, _mm_set1_ps(-INFINITY)));
+    __m128 max = _mm_max_ps(all, _mm_shuffle_ps(all, all, _MM_SHUFFLE(1, 0, 3, 2)));
+    max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_movemask_ps(_mm_cmpeq_ps(all, max)) & actions;
+#else
+    int votes = 0;
+    QValue max = 0;
+    for (int i = 0; i < ACTIONS; i++)
+    {
+        if (!(actions & 1 << i))
+        {
+            continue;
+        }
+        if (votes == 0 || values[i] > max)
+        {
+            max = values[i];
+            votes = 1 << i;
+        }
+        else if (values[i] == max)
+        {
+            votes |= 1 << i;
+        }
+    }
+    return votes;
+#endif
+}
+
+/**
+ * @brief Maximum Q-value of a cell, like max_q()
+ *
+ * @param values The 4 Q-values of a cell, aligned on 4 Q-values
+ * @return double Maximum Q-value
+ */
+static inline double best_value(const QValue *values)
+{
+#if defined(__SSE2__) && defined(QTYPE_DOUBLE)
+    __m128d max = _mm_max_pd(_mm_load_pd(values), _mm_load_pd(values + 2));
+    max = _mm_max_sd(max, _mm_unpackhi_pd(max, max));
+    return _mm_cvtsd_f64(max);
+#elif defined(__SSE2__) && defined(QTYPE_FLOAT)
+    __m128 all = _mm_load_ps(values);
+    __m128 max = _mm_max_ps(all, _mm_movehl_ps(all, all));
+    max = _mm_max_ss(max, _mm_shuffle_ps(max, max, 1));
+    return _mm_cvtss_f32(max);
+#else
+    QValue max = values[0] > values[1] ? values[0] : values[1];
+    max = values[2] > max ? values[2] : max;
+    return from_q_value(values[3] > max ? values[3] : max);
+#endif
+}
+
+/**
+ * @brief Pick the index of a random bit set in a bitmask
+ *
+ * @param actions Bitmask of actions
+ * @param draw Random value
+ * @return int Picked action
+ */
+static inline int pick_bit(int actions, uint32_t draw)
+{
+    int count = __builtin_popcount(actions);
+    if (count == 0)
+    {
+        return UP;
+    }
+    for (int i = ((uint64_t)draw * count) >> 32; i > 0; i--)
+    {
+        actions &= actions - 1;
+    }
+    return __builtin_ctz(actions);
+}
+
+#if defined(__AVX2__) && (defined(QTYPE_DOUBLE) || defined(QTYPE_FLOAT))
+/**
+ * @brief Choose the actions of 4 consecutive agents at once, each lane of the registers holding one agent
+ *
+ * The Q-values of each action are gathered from the rows of the 4 cells, so the maximum and the ties are found by vertical comparisons,
+ * and the best actions are blended with the possible ones of the exploring agents. Only the pick among the votes stays per agent.
+ *
+ * @param map Map containing the Q-table
+ * @param batch Batch of agents, with the draws of the step
+ * @param k Index of the first agent
+ * @param threshold Exploration threshold on the high bits of the draws
+ */
+static inline void select_lanes(const Map *map, Batch *batch, int k, uint32_t threshold)
+{
+    const int *cells = batch->cells + k;
+    const QValue *q = (*map).q;
+    __m128i possible = _mm_setr_epi32((*map).actions[cells[0]], (*map).actions[cells[1]], (*map).actions[cells[2]], (*map).actions[cells[3]]);
+    __m128i rows = _mm_slli_epi32(_mm_loadu_si128((const __m128i *)cells), 2);
+    __m256i draws = _mm256_loadu_si256((const __m256i *)(batch->draws + k));
+    int votes[4];
+#if defined(QTYPE_DOUBLE)
+    // one agent per 64-bit lane, impossible actions are replaced by -inf
+    __m256i lanes = _mm256_cvtepi32_epi64(possible);
+    __m256d values[ACTIONS];
+    __m256d max = _mm256_set1_pd(-INFINITY);
+    for (int a = 0; a < ACTIONS; a++)
+    {
+        __m256d mask = _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_and_si256(lanes, _mm256_set1_epi64x(1 << a)), _mm256_setzero_si256()));
+        values[a] = _mm256_blendv_pd(_mm256_set1_pd(-INFINITY), _mm256_i32gather_pd(q + a, rows, sizeof(QValue)), mask);
+        max = _mm256_max_pd(max, values[a]);
+    }
+    __m256i best = _mm256_setzero_si256();
+    for (int a = 0; a < ACTIONS; a++)
+    {
+        best = _mm256_or_si256(best, _mm256_and_si256(_mm256_castpd_si256(_mm256_cmp_pd(values[a], max, _CMP_EQ_OQ)), _mm256_set1_epi64x(1 << a)));
+    }
+    // an agent with no possible action would vote for every -inf lane
+    best = _mm256_and_si256(best, lanes);
+    __m256i explore = _mm256_cmpgt_epi64(_mm256_set1_epi64x(threshold), _mm256_srli_epi64(draws, 32));
+    best = _mm256_blendv_epi8(best, lanes, explore);
+    _mm_storeu_si128((__m128i *)votes, _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(best, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6))));
+#else
+    // one agent per 32-bit lane, impossible actions are replaced by -inf
+    __m128 values[ACTIONS];
+    __m128 max = _mm_set1_ps(-INFINITY);
+    for (int a = 0; a < ACTIONS; a++)
+    {
+        __m128 mask = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_and_si128(possible, _mm_set1_epi32(1 << a)), _mm_setzero_si128()));
+        values[a] = _mm_blendv_ps(_mm_set1_ps(-INFINITY), _mm_i32gather_ps(q + a, rows, sizeof(QValue)), mask);
+        max = _mm_max_ps(max, values[a]);
+    }
+    __m128i best = _mm_setzero_si128();
+    for (int a = 0; a < ACTIONS; a++)
+    {
+        best = _mm_or_si128(best, _mm_and_si128(_mm_castps_si128(_mm_cmpeq_ps(values[a], max)), _mm_set1_epi32(1 << a)));
+    }
+    best = _mm_and_si128(best, possible);
+    // the high halves of the draws are compared unsigned, by flipping their sign bit
+    __m128i high = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(draws, _mm256_setr_epi32(1, 3, 5, 7, 1, 3, 5, 7)));
+    __m128i sign = _mm_set1_epi32(INT32_MIN);
+    __m128i explore = _mm_cmpgt_epi32(_mm_xor_si128(_mm_set1_epi32(threshold), sign), _mm_xor_si128(high, sign));
+    best = _mm_blendv_epi8(best, possible, explore);
+    _mm_storeu_si128((__m128i *)votes, best);
+#endif
+    for (int i = 0; i < 4; i++)
+    {
+        batch->actions[k + i] = pick_bit(votes[i], batch->draws[k + i]);
+        INSTRUMENT_COUNT(RANDOM_ACTIONS, (batch->draws[k + i] >> 32) < threshold);
+    }
+}
+#endif
+
+void step_batch(Map *map, Batch *batch, Params params)
+{
+    int count = batch->count;
+    QValue *q = (*map).q;
+    const Transition *transitions = (*map).transitions;
+
+    // one 64-bit draw per agent: the high bits decide exploration, the low bits pick the action
+    INSTRUMENT_START(select_start);
+    draw_batch(batch);
+
+    // action selection
+    uint32_t threshold = params.epsilon >= 1 ? UINT32_MAX : (uint32_t)(params.epsilon * 4294967296.0);
+    int k = 0;
+#if defined(__AVX2__) && (defined(QTYPE_DOUBLE) || defined(QTYPE_FLOAT))
+    for (; k + 4 <= count; k += 4)
+    {
+        select_lanes(map, batch, k, threshold);
+    }
+#endif
+    // remaining agents, or all of them without AVX2, one cell at a time
+    for (; k < count; k++)
+    {
+        int cell = batch->cells[k];
+        int actions = (*map).actions[cell];
+        uint64_t draw = batch->draws[k];
+        int votes = (draw >> 32) < threshold ? actions : best_actions(&q[(size_t)cell * ACTIONS], actions);
+        batch->actions[k] = pick_bit(votes, draw);
+        INSTRUMENT_COUNT(RANDOM_ACTIONS, (draw >> 32) < threshold);
+    }
+    INSTRUMENT_STOP(select_start, SELECT);
+
+    // environment step
+    INSTRUMENT_START(reward_start);
+    for (int k = 0; k < count; k++)
+    {
+        Transition transition = transitions[(size_t)batch->cells[k] * ACTIONS + batch->actions[k]];
+        // a cell without possible action has no transition, the agent stays in place like in roll_out()
+        batch->next[k] = transition.next >= 0 ? transition.next : batch->cells[k];
+        batch->rewards[k] = transition.reward;
+        INSTRUMENT_COUNT(OFF_MAP, transition.next < 0);
+    }
+    INSTRUMENT_STOP(reward_start, REWARD);
+
+    // Q-table update, in agent order so that agents sharing a cell see each other's updates, which keeps it scalar
+    INSTRUMENT_START(update_start);
+    for (int k = 0; k < count; k++)
+    {
+        size_t index = (size_t)batch->cells[k] * ACTIONS + batch->actions[k];
+        double old = from_q_value(q[index]);
+        q[index] = to_q_value((1 - params.alpha) * old + params.alpha * (batch->rewards[k] + params.gamma * best_value(&q[(size_t)batch->next[k] * ACTIONS])));
+        if (params.tolerance > 0)
+        {
+            track_update(&(*map).deltas, *map, batch->cells[k], (*map).actions[batch->cells[k]], batch->actions[k], old, params.tolerance);
+        }
+    }
+    INSTRUMENT_STOP(update_start, UPDATE);
+
+    // move agents, walls stop them and goals send them back to the start
+    int start = get_cell(*map, (*map).start);
+    for (int k = 0; k < count; k++)
+    {
+        int next = batch->next[k];
+        enum Type type = (*map).map[next];
+        if (type == GOAL_1 || type == GOAL_2)
+        {
+            batch->cells[k] = start;
+            batch->epochs++;
+        }
+        else if (type != WALL)
+        {
+            batch->cells[k] = next;
+        }
+        INSTRUMENT_COUNT(WALL_BUMPS, type == WALL);
+    }
+    batch->steps += count;
+    INSTRUMENT_COUNT(STEPS, count);
+}
@@ -0,0 +1,98 @@
+/**
+ * @file batch.h
+ * @author Antoine Qiu
+ * @brief Definition of the batched environment, stepping many agents at once
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include "q_learning.h"
+#include "params.h"
+
+/**
+ * @brief Structure of arrays holding the agents of a batch
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Number of agents
+     *
+     */
+    int count;
+    /**
+     * @brief Cell index of each agent
+     *
+     */
+    int *cells;
+    /**
+     * @brief Action chosen by each agent
+     *
+     */
+    int *actions;
+    /**
+     * @brief Cell index reached by each agent, before walls are applied, its own cell if the action leaves the map
+     *
+     */
+    int *next;
+    /**
+     * @brief Reward received by each agent
+     *
+     */
+    int *rewards;
+    /**
+     * @brief Random value drawn by each agent for the current step
+     *
+     */
+    uint64_t *draws;
+    /**
+     * @brief Random generator states, stored as 4 arrays of count values so that all agents advance together
+     *
+     */
+    uint64_t *random;
+    /**
+     * @brief Number of epochs finished by all the agents
+     *
+     */
+    int epochs;
+    /**
+     * @brief Number of steps done by all the agents
+     *
+     */
+    long steps;
+} Batch;
+
+/**
+ * @brief Allocate a batch of agents, all placed on the starting position
+ *
+ * @param batch Batch to initialize
+ * @param map Map containing the starting position and the random generator used to seed the agents
+ * @param count Number of agents
+ * @return int Status
+ */
+int init_batch(Batch *batch, Map *map, int count);
+/**
+ * @brief Free a batch of agents
+ *
+ * @param batch Batch to free
+ */
+void free_batch(Batch batch);
+/**
+ * @brief Advance every agent of a batch by one Q-learning step, all agents updating the same Q-table
+ *
+ * With AVX2 the actions are chosen 4 agents at a time, one per lane. Otherwise only the argmax of each cell is SIMD (SSE2).
+ * The Q-table updates stay scalar, in agent order.
+ *
+ * @param map Map containing the Q-table, with its transition table built
+ * @param batch Batch of agents
+ * @param params Parameters
+ */
+void step_batch(Map *map, Batch *batch, Params params);
+
+#endif
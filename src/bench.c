@@ -0,0 +1,726 @@
+/**
+ * @file bench.c
+ * @author Antoine Qiu
+ * @brief Benchmark of the training engine
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "q_learning.h"
+#include "batch.h"
+#include "params.h"
+#include "route.h"
+
+/**
+ * @brief Maximum number of values in a benchmark option list
+ *
+ */
+#define BENCH_LIST 16
+
+/**
+ * @brief Engines that can be benchmarked
+ *
+ */
+enum Engine
+{
+    /**
+     * @brief q() stepping one agent
+     *
+     */
+    SCALAR = 0,
+    /**
+     * @brief q() stepping one agent with the transition table
+     *
+     */
+    TRANSITIONS = 1,
+    /**
+     * @brief step_batch() stepping many agents
+     *
+     */
+    BATCH = 2,
+    /**
+     * @brief q() stepping one agent per thread on the shared Q-table
+     *
+     */
+    THREADS = 3
+};
+
+/**
+ * @brief Names of the engines
+ *
+ */
+const char *engine_names[] = {"scalar", "transitions", "batch", "threads"};
+/**
+ * @brief Names of the modes
+ *
+ */
+const char *mode_names[] = {"default", "euclidean", "teleporter", "loop"};
+/**
+ * @brief Names of the Q-value types, indexed by Q_TYPE
+ *
+ */
+const char *qtype_names[] = {"double", "float", "int16"};
+
+/**
+ * @brief Structure containing the options of the benchmark
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Map sizes, 6 is the default map
+     *
+     */
+    int sizes[BENCH_LIST];
+    /**
+     * @brief Number of map sizes
+     *
+     */
+    int sizes_count;
+    /**
+     * @brief Modes, indices in mode_names
+     *
+     */
+    int modes[BENCH_LIST];
+    /**
+     * @brief Number of modes
+     *
+     */
+    int modes_count;
+    /**
+     * @brief Engines, indices in engine_names
+     *
+     */
+    int engines[BENCH_LIST];
+    /**
+     * @brief Number of engines
+     *
+     */
+    int engines_count;
+    /**
+     * @brief Steps per measured run
+     *
+     */
+    long steps;
+    /**
+     * @brief Number of measured runs
+     *
+     */
+    int repeat;
+    /**
+     * @brief Number of agents of the batch engine
+     *
+     */
+    int agents;
+    /**
+     * @brief Maximum number of threads of the threads engine, which runs with 1, 2, 4... threads up to it
+     *
+     */
+    int threads;
+    /**
+     * @brief Seed of the maps and of the agents
+     *
+     */
+    long seed;
+    /**
+     * @brief Time limit of the convergence measure in seconds, 0 to skip it
+     *
+     */
+    double convergence;
+    /**
+     * @brief Output JSON lines instead of CSV
+     *
+     */
+    int json;
+} Bench;
+
+/**
+ * @brief Structure containing the result of a measured run
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Number of steps
+     *
+     */
+    long steps;
+    /**
+     * @brief Number of finished epochs
+     *
+     */
+    long epochs;
+    /**
+     * @brief Duration in seconds
+     *
+     */
+    double time;
+} Run;
+
+/**
+ * @brief Structure representing a benchmark thread
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Copy of the shared map
+     *
+     */
+    Map map;
+    /**
+     * @brief Parameters
+     *
+     */
+    Params params;
+    /**
+     * @brief Result of the thread
+     *
+     */
+    Run run;
+} BenchThread;
+
+/**
+ * @brief Get a monotonic time in seconds
+ *
+ * @return double Time
+ */
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Generate a square map with 10% of walls, goal 1 in a corner, goal 2 in the middle and the start in the opposite corner
+ *
+ * @param map Map to initialize with the generated map
+ * @param size Width and height of the map
+ * @param teleporter Add a teleporter from near the start to near goal 1
+ * @param random Random generator
+ * @return int Status
+ */
+int generate_map(Map *map, int size, int teleporter, Random *random)
+{
+    *map = allocate_map(size, size, 0);
+    if ((*map).map == NULL || (*map).q == NULL || (*map).actions == NULL)
+    {
+        free_map(*map);
+        return 0;
+    }
+    for (int i = 0; i < size * size; i++)
+    {
+        (*map).map[i] = random_int(random, 10) == 0 ? WALL : EMPTY;
+    }
+    (*map).map[0] = GOAL_1;
+    (*map).map[size / 2 * size + size / 2] = GOAL_2;
+    (*map).start = (State){size - 1, size - 1};
+    (*map).map[get_cell(*map, (*map).start)] = EMPTY;
+    if (teleporter)
+    {
+        (*map).map[get_cell(*map, (State){size - 3, size - 1})] = TELEPORTER_1;
+        (*map).map[get_cell(*map, (State){2, 0})] = TELEPORTER_2;
+    }
+    (*map).agent = (*map).start;
+    if (!index_map(map))
+    {
+        free_map(*map);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Run q() for a number of steps, like the main loop
+ *
+ * @param map Map containing the agent
+ * @param params Parameters
+ * @param steps Number of steps
+ * @return Run Result
+ */
+Run run_scalar(Map *map, Params params, long steps)
+{
+    Run run = {steps, 0, now()};
+    for (long i = 0; i < steps; i++)
+    {
+        State next_state = q(map, map->agent, params);
+        if (get_type(*map, next_state) != WALL)
+        {
+            map->agent = next_state;
+        }
+        enum Type type = get_type(*map, map->agent);
+        if (type == GOAL_1 || type == GOAL_2)
+        {
+            map->agent = map->start;
+            run.epochs++;
+        }
+    }
+    run.time = now() - run.time;
+    return run;
+}
+
+/**
+ * @brief Run q() on a benchmark thread
+ *
+ * @param arg Benchmark thread
+ * @return void* NULL
+ */
+void *run_thread(void *arg)
+{
+    BenchThread *thread = arg;
+    thread->run = run_scalar(&thread->map, thread->params, thread->run.steps);
+    return NULL;
+}
+
+/**
+ * @brief Run q() on several threads sharing the Q-table for a total number of steps
+ *
+ * @param map Map containing the shared Q-table
+ * @param params Parameters
+ * @param steps Number of steps
+ * @param count Number of threads
+ * @return Run Result, with no step if a thread could not start
+ */
+Run run_threads(Map *map, Params params, long steps, int count)
+{
+    BenchThread threads[count];
+    pthread_t ids[count];
+    Run run = {0, 0, now()};
+    for (int i = 0; i < count; i++)
+    {
+        jump_random(&map->random);
+        threads[i] = (BenchThread){*map, params, {steps / count, 0, 0}};
+        if (pthread_create(&ids[i], NULL, run_thread, &threads[i]) != 0)
+        {
+            // the threads already started are joined, the run is not measured
+            fprintf(stderr, "Could not start thread %d of %d\n", i + 1, count);
+            for (int j = 0; j < i; j++)
+            {
+                pthread_join(ids[j], NULL);
+            }
+            return (Run){0, 0, 0};
+        }
+    }
+    for (int i = 0; i < count; i++)
+    {
+        pthread_join(ids[i], NULL);
+        run.steps += threads[i].run.steps;
+        run.epochs += threads[i].run.epochs;
+    }
+    run.time = now() - run.time;
+    return run;
+}
+
+/**
+ * @brief Run step_batch() for a number of steps
+ *
+ * @param map Map containing the Q-table
+ * @param params Parameters
+ * @param steps Number of steps, rounded to a multiple of the number of agents
+ * @param agents Number of agents
+ * @return Run Result
+ */
+Run run_batch(Map *map, Params params, long steps, int agents)
+{
+    Batch batch;
+    Run run = {0, 0, 0};
+    if (!init_batch(&batch, map, agents))
+    {
+        return run;
+    }
+    run.time = now();
+    while (batch.steps < steps)
+    {
+        step_batch(map, &batch, params);
+    }
+    run = (Run){batch.steps, batch.epochs, now() - run.time};
+    free_batch(batch);
+    return run;
+}
+
+/**
+ * @brief Run the loop mode for a number of steps, switching Q-tables at each checkpoint like the main loop
+ *
+ * @param map Default map
+ * @param params Parameters, in test mode
+ * @param steps Number of steps
+ * @return Run Result
+ */
+Run run_loop(Map *map, Params params, long steps)
+{
+    Route route;
+    if (!init_route(&route, map, params))
+    {
+        return (Run){0, 0, 0};
+    }
+    Run run = {steps, 0, now()};
+    for (long i = 0; i < steps; i++)
+    {
+        State next_state = q(map, map->agent, params);
+        if (get_type(*map, next_state) != WALL)
+        {
+            map->agent = next_state;
+        }
+        run.epochs += advance_route(&route, map);
+    }
+    run.time = now() - run.time;
+    free_route(&route, map);
+    return run;
+}
+
+/**
+ * @brief Measure the time until the greedy path stops changing for 5 consecutive checks
+ *
+ * @param map Map containing the Q-table, reset beforehand
+ * @param params Parameters
+ * @param limit Time limit in seconds
+ * @param epochs Number of epochs until convergence, -1 if the limit is reached
+ * @param path Length of the last greedy path, -1 if it reaches no goal
+ * @return double Time until convergence in seconds, -1 if the limit is reached
+ */
+double measure_convergence(Map *map, Params params, double limit, long *epochs, int *path)
+{
+    double start = now();
+    int last = -1;
+    int stable = 0;
+    *epochs = 0;
+    *path = -1;
+    while (now() - start < limit)
+    {
+        // one check every 100 epochs
+        for (int i = 0; i < 100; i++)
+        {
+            // episodes are capped since some reward shapings trap the agent in a cycle
+            map->agent = map->start;
+            enum Type type = EMPTY;
+            for (long step = 0; type != GOAL_1 && type != GOAL_2 && step < 100L * map->width * map->height; step++)
+            {
+                State next_state = q(map, map->agent, params);
+                if (get_type(*map, next_state) != WALL)
+                {
+                    map->agent = next_state;
+                }
+                type = get_type(*map, map->agent);
+            }
+        }
+        *epochs += 100;
+        *path = greedy_path(*map, params);
+        stable = *path > 0 && *path == last ? stable + 1 : 0;
+        last = *path;
+        if (stable == 5)
+        {
+            return now() - start;
+        }
+    }
+    *epochs = -1;
+    return -1;
+}
+
+/**
+ * @brief Get the memory used by the tables of a map
+ *
+ * @param map Map
+ * @return size_t Size in bytes
+ */
+size_t map_memory(Map map)
+{
+    size_t cells = (size_t)map.width * map.height;
+    size_t size = cells * (sizeof(int) + sizeof(unsigned char));
+    size += map.sparse != NULL ? sparse_memory(map.sparse) : cells * ACTIONS * sizeof(QValue);
+    if (map.transitions != NULL)
+    {
+        size += cells * ACTIONS * sizeof(Transition);
+    }
+    if (map.landmarks.links != NULL)
+    {
+        size += cells * sizeof(int);
+    }
+    return size;
+}
+
+/**
+ * @brief Parse a comma-separated list of integers or names
+ *
+ * @param text List to parse
+ * @param names Accepted names, NULL for integers
+ * @param count Number of names
+ * @param values Parsed values
+ * @return int Number of values, -1 on unknown name
+ */
+int parse_list(char *text, const char **names, int count, int *values)
+{
+    int n = 0;
+    for (char *item = strtok(text, ","); item != NULL && n < BENCH_LIST; item = strtok(NULL, ","))
+    {
+        if (names == NULL)
+        {
+            values[n++] = atoi(item);
+            continue;
+        }
+        int found = -1;
+        for (int i = 0; i < count; i++)
+        {
+            if (strcmp(item, names[i]) == 0)
+            {
+                found = i;
+            }
+        }
+        if (found < 0)
+        {
+            return -1;
+        }
+        values[n++] = found;
+    }
+    return n;
+}
+
+/**
+ * @brief Print the help of the benchmark
+ *
+ */
+void print_bench_help()
+{
+    printf("Usage: ./bench [options]\n");
+    printf("Options:\n");
+    printf("-sizes <list> (default: 6,64,256,1024) : Map sizes, 6 is the default map, others are generated\n");
+    printf("-modes <list> (default: default,euclidean,teleporter,loop) : Modes, loop only runs on the default map\n");
+    printf("-engines <list> (default: scalar,transitions,batch,threads) : Engines\n");
+    printf("-steps <int> (default: 2000000) : Steps per measured run\n");
+    printf("-repeat <int> (default: 5) : Number of measured runs, after one warm-up run\n");
+    printf("-agents <int> (default: 256) : Number of agents of the batch engine\n");
+    printf("-threads <int> (default: number of cores) : Maximum number of threads of the threads engine, run with 1, 2, 4... threads up to it\n");
+    printf("-seed <int> (default: 1) : Seed of the maps and of the agents\n");
+    printf("-convergence <float> (default: 10) : Time limit in seconds of the convergence measure, 0 to skip it\n");
+    printf("-json : Output JSON lines instead of CSV\n");
+    printf("-help : Print the help message\n");
+}
+
+/**
+ * @brief Benchmark one engine on one map and print the result
+ *
+ * @param bench Options
+ * @param map Map to run on
+ * @param params Parameters of the mode
+ * @param size Size of the map
+ * @param mode Mode
+ * @param engine Engine
+ * @param threads Number of threads of the threads engine, 1 for the others
+ */
+void bench_engine(Bench bench, Map *map, Params params, int size, int mode, int engine, int threads)
+{
+    size_t q_size = (size_t)map->width * map->height * ACTIONS * sizeof(QValue);
+    if ((engine == TRANSITIONS || engine == BATCH) && map->transitions == NULL)
+    {
+        build_transitions(map, params);
+    }
+    if (engine == SCALAR || engine == THREADS)
+    {
+        free(map->transitions);
+        map->transitions = NULL;
+    }
+
+    double rates[bench.repeat];
+    double epoch_rates[bench.repeat];
+    for (int r = -1; r < bench.repeat; r++)
+    {
+        // every run starts from the same state, the first one is a warm-up
+        memset(map->q, 0, q_size);
+        map->agent = map->start;
+        seed_random(&map->random, bench.seed);
+        long steps = r < 0 ? bench.steps / 10 : bench.steps;
+        Run run;
+        switch (engine)
+        {
+        case TRANSITIONS:
+        case SCALAR:
+            run = mode == 3 ? run_loop(map, params, steps) : run_scalar(map, params, steps);
+            break;
+        case BATCH:
+            run = run_batch(map, params, steps, bench.agents);
+            break;
+        default:
+            run = run_threads(map, params, steps, threads);
+            break;
+        }
+        if (r >= 0)
+        {
+            rates[r] = run.time > 0 ? run.steps / run.time : 0;
+            epoch_rates[r] = run.time > 0 ? run.epochs / run.time : 0;
+        }
+    }
+
+    // mean and standard deviation of the runs
+    double mean = 0, epochs_mean = 0, deviation = 0;
+    for (int r = 0; r < bench.repeat; r++)
+    {
+        mean += rates[r] / bench.repeat;
+        epochs_mean += epoch_rates[r] / bench.repeat;
+    }
+    for (int r = 0; r < bench.repeat; r++)
+    {
+        deviation += (rates[r] - mean) * (rates[r] - mean) / bench.repeat;
+    }
+    deviation = sqrt(deviation);
+
+    // convergence is only measured with the reference engine
+    double convergence = -1;
+    long convergence_epochs = -1;
+    int greedy_steps = -1;
+    if (engine == SCALAR && mode != 3 && bench.convergence > 0)
+    {
+        memset(map->q, 0, q_size);
+        seed_random(&map->random, bench.seed);
+        convergence = measure_convergence(map, params, bench.convergence, &convergence_epochs, &greedy_steps);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    if (bench.json)
+    {
+        printf("{\"size\": %d, \"mode\": \"%s\", \"engine\": \"%s\", \"threads\": %d, \"qtype\": \"%s\", \"steps_per_s\": %.0f, \"steps_per_s_stddev\": %.0f, \"epochs_per_s\": %.1f, "
+               "\"convergence_s\": %.3f, \"convergence_epochs\": %ld, \"greedy_steps\": %d, \"memory_bytes\": %zu, \"max_rss_kb\": %ld}\n",
+               size, mode_names[mode], engine_names[engine], threads, qtype_names[Q_TYPE], mean, deviation, epochs_mean, convergence, convergence_epochs, greedy_steps,
+               map_memory(*map), usage.ru_maxrss);
+    }
+    else
+    {
+        printf("%d,%s,%s,%d,%s,%.0f,%.0f,%.1f,%.3f,%ld,%d,%zu,%ld\n",
+               size, mode_names[mode], engine_names[engine], threads, qtype_names[Q_TYPE], mean, deviation, epochs_mean, convergence, convergence_epochs, greedy_steps,
+               map_memory(*map), usage.ru_maxrss);
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief Main function of the benchmark
+ *
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return int Status
+ */
+int main(int argc, char **argv)
+{
+    Bench bench = {{6, 64, 256, 1024}, 4, {0, 1, 2, 3}, 4, {0, 1, 2, 3}, 4, 2000000, 5, 256, sysconf(_SC_NPROCESSORS_ONLN), 1, 10, 0};
+    for (int i = 1; i < argc; i++)
+    {
+        int status = 0;
+        if (strcmp(argv[i], "-sizes") == 0 && i + 1 < argc)
+        {
+            status = bench.sizes_count = parse_list(argv[++i], NULL, 0, bench.sizes);
+        }
+        else if (strcmp(argv[i], "-modes") == 0 && i + 1 < argc)
+        {
+            status = bench.modes_count = parse_list(argv[++i], mode_names, 4, bench.modes);
+        }
+        else if (strcmp(argv[i], "-engines") == 0 && i + 1 < argc)
+        {
+            status = bench.engines_count = parse_list(argv[++i], engine_names, 4, bench.engines);
+        }
+        else if (strcmp(argv[i], "-steps") == 0 && i + 1 < argc)
+        {
+            status = (bench.steps = atol(argv[++i])) > 0;
+        }
+        else if (strcmp(argv[i], "-repeat") == 0 && i + 1 < argc)
+        {
+            status = (bench.repeat = atoi(argv[++i])) > 0;
+        }
+        else if (strcmp(argv[i], "-agents") == 0 && i + 1 < argc)
+        {
+            status = (bench.agents = atoi(argv[++i])) > 0;
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            status = (bench.threads = atoi(argv[++i])) > 0;
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            bench.seed = atol(argv[++i]);
+            status = 1;
+        }
+        else if (strcmp(argv[i], "-convergence") == 0 && i + 1 < argc)
+        {
+            bench.convergence = atof(argv[++i]);
+            status = 1;
+        }
+        else if (strcmp(argv[i], "-json") == 0)
+        {
+            bench.json = 1;
+            status = 1;
+        }
+        else if (strcmp(argv[i], "-help") == 0)
+        {
+            print_bench_help();
+            return 0;
+        }
+        if (status <= 0)
+        {
+            printf("Invalid parameter: %s\n", argv[i]);
+            print_bench_help();
+            return 1;
+        }
+    }
+
+    if (!bench.json)
+    {
+        printf("size,mode,engine,threads,qtype,steps_per_s,steps_per_s_stddev,epochs_per_s,convergence_s,convergence_epochs,greedy_steps,memory_bytes,max_rss_kb\n");
+    }
+
+    for (int s = 0; s < bench.sizes_count; s++)
+    {
+        for (int m = 0; m < bench.modes_count; m++)
+        {
+            int size = bench.sizes[s];
+            int mode = bench.modes[m];
+            // the loop Q-tables are made for the default map
+            if (mode == 3 && size != 6)
+            {
+                continue;
+            }
+
+            Params params = {0};
+            params.epochs = -1;
+            params.epsilon = EPSILON;
+            params.alpha = ALPHA;
+            params.gamma = GAMMA;
+            params.euclidean = mode == 1;
+            params.teleporter = mode == 2;
+            params.test = mode == 3;
+
+            Random random;
+            seed_random(&random, bench.seed);
+            Map map;
+            if (size == 6 ? !build_map(&map, params.teleporter, 0) : !generate_map(&map, size, params.teleporter, &random))
+            {
+                fprintf(stderr, "Failed to build map of size %d\n", size);
+                return 1;
+            }
+            for (int e = 0; e < bench.engines_count; e++)
+            {
+                // the loop mode only changes the Q-table between steps, which only applies to single-agent engines
+                if (mode == 3 && bench.engines[e] != SCALAR && bench.engines[e] != TRANSITIONS)
+                {
+                    continue;
+                }
+                if (bench.engines[e] != THREADS)
+                {
+                    bench_engine(bench, &map, params, size, mode, bench.engines[e], 1);
+                    continue;
+                }
+                // the threads engine is swept over the thread counts for its scaling curve
+                for (int threads = 1; threads < bench.threads * 2; threads *= 2)
+                {
+                    bench_engine(bench, &map, params, size, mode, THREADS, threads < bench.threads ? threads : bench.threads);
+                }
+            }
+            free_map(map);
+        }
+    }
+    return 0;
+}
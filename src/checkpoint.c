@@ -0,0 +1,157 @@
+/**
+ * @file checkpoint.c
+ * @author Antoine Qiu
+ * @brief Implementation of the background checkpoints of the Q-table
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "checkpoint.h"
+
+/**
+ * @brief Write the snapshots to the checkpoint file whenever one is taken
+ *
+ * @param arg Checkpoint writer
+ * @return void* NULL
+ */
+static void *run_checkpoint(void *arg)
+{
+    Checkpoint *checkpoint = arg;
+
+    pthread_mutex_lock(&checkpoint->mutex);
+    while (1)
+    {
+        while (!checkpoint->busy && !checkpoint->stop)
+        {
+            pthread_cond_wait(&checkpoint->cond, &checkpoint->mutex);
+        }
+        if (!checkpoint->busy)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&checkpoint->mutex);
+
+        // the temporary file is renamed once complete, so the checkpoint file is never partially written
+        if (!save_q(checkpoint->snapshot, checkpoint->temporary) || rename(checkpoint->temporary, checkpoint->filename) != 0)
+        {
+            printf("Failed to save checkpoint to %s\n", checkpoint->filename);
+        }
+
+        pthread_mutex_lock(&checkpoint->mutex);
+        __atomic_store_n(&checkpoint->busy, 0, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&checkpoint->cond);
+    }
+    pthread_mutex_unlock(&checkpoint->mutex);
+    return NULL;
+}
+
+int start_checkpoint(Checkpoint *checkpoint, Map map, Params params)
+{
+    checkpoint->filename = params.checkpoint;
+    checkpoint->every = params.checkpoint_every;
+    checkpoint->seconds = params.checkpoint_seconds;
+    checkpoint->last_epoch = map.epoch;
+    checkpoint->last_time = time(NULL);
+    checkpoint->busy = 0;
+    checkpoint->stop = 0;
+
+    // the temporary file keeps the extension so that it is saved in the same format
+    size_t length = strlen(params.checkpoint) + strlen(".tmp") + strlen(Q_EXTENSION) + 1;
+    checkpoint->temporary = malloc(length);
+    checkpoint->snapshot = map;
+    checkpoint->snapshot.mapping = NULL;
+    checkpoint->snapshot.q = map.sparse != NULL ? NULL : malloc((size_t)map.width * map.height * ACTIONS * sizeof(QValue));
+    checkpoint->snapshot.sparse = map.sparse != NULL ? allocate_sparse(map.sparse->capacity) : NULL;
+    if (checkpoint->temporary == NULL || (checkpoint->snapshot.q == NULL && checkpoint->snapshot.sparse == NULL))
+    {
+        free(checkpoint->temporary);
+        free(checkpoint->snapshot.q);
+        free_sparse(checkpoint->snapshot.sparse);
+        return 0;
+    }
+    snprintf(checkpoint->temporary, length, "%s.tmp%s", params.checkpoint, is_binary(params.checkpoint) ? Q_EXTENSION : "");
+
+    pthread_mutex_init(&checkpoint->mutex, NULL);
+    pthread_cond_init(&checkpoint->cond, NULL);
+    if (pthread_create(&checkpoint->thread, NULL, run_checkpoint, checkpoint) != 0)
+    {
+        free(checkpoint->temporary);
+        free(checkpoint->snapshot.q);
+        free_sparse(checkpoint->snapshot.sparse);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Copy the Q-table into the snapshot buffer and wake the writer up
+ *
+ * @param checkpoint Checkpoint writer, idle
+ * @param map Map containing the Q-table and the epoch counter
+ */
+static void take_snapshot(Checkpoint *checkpoint, Map map)
+{
+    if (map.sparse != NULL)
+    {
+        // a snapshot that cannot follow the growth of the sparse Q-table is skipped, the next one may succeed
+        if (!copy_sparse(checkpoint->snapshot.sparse, map.sparse))
+        {
+            return;
+        }
+    }
+    else
+    {
+        memcpy(checkpoint->snapshot.q, map.q, (size_t)map.width * map.height * ACTIONS * sizeof(QValue));
+    }
+    checkpoint->snapshot.epoch = map.epoch;
+    checkpoint->last_epoch = map.epoch;
+    checkpoint->last_time = time(NULL);
+
+    pthread_mutex_lock(&checkpoint->mutex);
+    checkpoint->busy = 1;
+    pthread_cond_broadcast(&checkpoint->cond);
+    pthread_mutex_unlock(&checkpoint->mutex);
+}
+
+void tick_checkpoint(Checkpoint *checkpoint, Map map)
+{
+    if (checkpoint->seconds ? time(NULL) - checkpoint->last_time < checkpoint->every : map.epoch - checkpoint->last_epoch < checkpoint->every)
+    {
+        return;
+    }
+
+    // the training never waits for the writer, a busy writer just delays the checkpoint
+    if (!__atomic_load_n(&checkpoint->busy, __ATOMIC_ACQUIRE))
+    {
+        take_snapshot(checkpoint, map);
+    }
+}
+
+void stop_checkpoint(Checkpoint *checkpoint, Map map)
+{
+    // wait for the current write, then write the final state
+    pthread_mutex_lock(&checkpoint->mutex);
+    while (checkpoint->busy)
+    {
+        pthread_cond_wait(&checkpoint->cond, &checkpoint->mutex);
+    }
+    pthread_mutex_unlock(&checkpoint->mutex);
+    if (map.epoch != checkpoint->last_epoch)
+    {
+        take_snapshot(checkpoint, map);
+    }
+
+    pthread_mutex_lock(&checkpoint->mutex);
+    checkpoint->stop = 1;
+    pthread_cond_broadcast(&checkpoint->cond);
+    pthread_mutex_unlock(&checkpoint->mutex);
+    pthread_join(checkpoint->thread, NULL);
+
+    pthread_mutex_destroy(&checkpoint->mutex);
+    pthread_cond_destroy(&checkpoint->cond);
+    free(checkpoint->temporary);
+    free(checkpoint->snapshot.q);
+    free_sparse(checkpoint->snapshot.sparse);
+}
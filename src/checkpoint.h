@@ -0,0 +1,111 @@
+/**
+ * @file checkpoint.h
+ * @author Antoine Qiu
+ * @brief Definition of the background checkpoints of the Q-table
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "q_learning.h"
+#include "params.h"
+
+/**
+ * @brief Structure representing the background writer of checkpoints
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Name of the checkpoint file
+     *
+     */
+    char *filename;
+    /**
+     * @brief Name of the temporary file renamed to the checkpoint file once written
+     *
+     */
+    char *temporary;
+    /**
+     * @brief Copy of the map whose Q-table is the snapshot buffer
+     *
+     */
+    Map snapshot;
+    /**
+     * @brief Interval between two checkpoints, in epochs or in seconds
+     *
+     */
+    int every;
+    /**
+     * @brief Whether the interval is in seconds
+     *
+     */
+    int seconds;
+    /**
+     * @brief Epoch of the last checkpoint
+     *
+     */
+    int last_epoch;
+    /**
+     * @brief Time of the last checkpoint
+     *
+     */
+    time_t last_time;
+    /**
+     * @brief Whether the snapshot buffer is waiting to be written
+     *
+     */
+    int busy;
+    /**
+     * @brief Whether the writer thread must stop
+     *
+     */
+    int stop;
+    /**
+     * @brief Writer thread
+     *
+     */
+    pthread_t thread;
+    /**
+     * @brief Mutex protecting busy and stop
+     *
+     */
+    pthread_mutex_t mutex;
+    /**
+     * @brief Condition signaled when busy or stop change
+     *
+     */
+    pthread_cond_t cond;
+} Checkpoint;
+
+/**
+ * @brief Allocate the snapshot buffer and start the writer thread
+ *
+ * @param checkpoint Checkpoint writer to start
+ * @param map Map containing the Q-table to checkpoint
+ * @param params Parameters, with the checkpoint file and interval
+ * @return int Status
+ */
+int start_checkpoint(Checkpoint *checkpoint, Map map, Params params);
+/**
+ * @brief Take a snapshot of the Q-table if a checkpoint is due and the writer is idle, the file is written in the background
+ *
+ * @param checkpoint Checkpoint writer
+ * @param map Map containing the Q-table and the epoch counter
+ */
+void tick_checkpoint(Checkpoint *checkpoint, Map map);
+/**
+ * @brief Write a last checkpoint, stop the writer thread and free the snapshot buffer
+ *
+ * @param checkpoint Checkpoint writer
+ * @param map Map containing the Q-table and the epoch counter
+ */
+void stop_checkpoint(Checkpoint *checkpoint, Map map);
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * @file convergence.c
+ * @author Antoine Qiu
+ * @brief Implementation of the convergence detection for early stopping
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "convergence.h"
+
+void init_convergence(Convergence *convergence)
+{
+    *convergence = (Convergence){0, -1, 0, {0, 0, 0, 0}};
+}
+
+int check_convergence(Convergence *convergence, Deltas *deltas, Params params, int epoch, int epochs)
+{
+    // epochs without updates, when the replay buffer learns less often than once per epoch, are checked with the next ones
+    if (deltas->updates == 0)
+    {
+        convergence->pending += epochs;
+        return convergence->epoch >= 0;
+    }
+    if (deltas->max <= params.tolerance && deltas->changes == 0)
+    {
+        convergence->stable += convergence->pending + epochs;
+    }
+    else
+    {
+        convergence->stable = 0;
+    }
+    convergence->pending = 0;
+    convergence->last = *deltas;
+    *deltas = (Deltas){0, 0, 0, 0};
+
+    // the first epoch of the converged streak is reported
+    if (convergence->epoch < 0 && convergence->stable >= params.patience)
+    {
+        convergence->epoch = epoch - convergence->stable + 1;
+    }
+    return convergence->epoch >= 0;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file convergence.h
+ * @author Antoine Qiu
+ * @brief Definition of the convergence detection for early stopping
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef CONVERGENCE_H
+#define CONVERGENCE_H
+
+#include "q_learning.h"
+#include "params.h"
+
+/**
+ * @brief Structure containing the state of the convergence detection
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Number of consecutive converged epochs
+     *
+     */
+    int stable;
+    /**
+     * @brief Epoch at which the Q-table converged, -1 while not converged
+     *
+     */
+    int epoch;
+    /**
+     * @brief Number of epochs without any update since the last check, counted with the next one
+     *
+     */
+    int pending;
+    /**
+     * @brief Updates of the last check
+     *
+     */
+    Deltas last;
+} Convergence;
+
+/**
+ * @brief Initialize the convergence detection
+ *
+ * @param convergence Convergence detection
+ */
+void init_convergence(Convergence *convergence);
+
+/**
+ * @brief Check the updates of the last epochs and reset them
+ *
+ * Epochs converge when no Q-value changes by more than the tolerance and no greedy action changes,
+ * epochs without any update are counted with the next check that has updates. The Q-table converged after patience consecutive converged epochs.
+ *
+ * @param convergence Convergence detection
+ * @param deltas Updates of the last epochs, reset afterwards
+ * @param params Parameters
+ * @param epoch Current epoch
+ * @param epochs Number of epochs covered by the updates
+ * @return int 1 if the Q-table converged, 0 otherwise
+ */
+int check_convergence(Convergence *convergence, Deltas *deltas, Params params, int epoch, int epochs);
+
+#endif
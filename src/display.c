@@ -0,0 +1,134 @@
+/**
+ * @file display.c
+ * @author Antoine Qiu
+ * @brief Implementation of the snapshots and control messages exchanged between the trainer and the GUI
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "display.h"
+
+int init_display(Display *display, Map map, int copy_q)
+{
+    *display = (Display){0};
+    display->back = 0;
+    display->shared = 1;
+    display->front = 2;
+    display->copy_q = copy_q;
+    size_t size = (size_t)map.width * map.height * ACTIONS * sizeof(QValue);
+    int status = 1;
+    for (int i = 0; i < 3; i++)
+    {
+        Map *snapshot = &display->snapshots[i];
+        *snapshot = map;
+        snapshot->mapping = NULL;
+        snapshot->q = NULL;
+        snapshot->sparse = NULL;
+        if (!copy_q || !status)
+        {
+            continue;
+        }
+        if (map.sparse != NULL)
+        {
+            snapshot->sparse = allocate_sparse(map.sparse->capacity);
+            status = snapshot->sparse != NULL && copy_sparse(snapshot->sparse, map.sparse);
+        }
+        else
+        {
+            snapshot->q = malloc(size);
+            status = snapshot->q != NULL;
+            if (status)
+            {
+                memcpy(snapshot->q, map.q, size);
+            }
+        }
+    }
+    if (!status)
+    {
+        free_display(display);
+    }
+    return status;
+}
+
+void free_display(Display *display)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        free(display->snapshots[i].q);
+        free_sparse(display->snapshots[i].sparse);
+        display->snapshots[i].q = NULL;
+        display->snapshots[i].sparse = NULL;
+    }
+}
+
+void publish_display(Display *display, Map map, int force)
+{
+    if (!force && ++display->calls < PUBLISH_CHECK)
+    {
+        return;
+    }
+    display->calls = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    long long now = (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    if (!force && now - display->published < 1000000000 / DISPLAY_FPS)
+    {
+        return;
+    }
+
+    Map *snapshot = &display->snapshots[display->back];
+    if (display->copy_q)
+    {
+        // a sparse Q-table that grew too much for the snapshot is published at the next frame
+        if (map.sparse != NULL && !copy_sparse(snapshot->sparse, map.sparse))
+        {
+            return;
+        }
+        if (map.sparse == NULL)
+        {
+            memcpy(snapshot->q, map.q, (size_t)map.width * map.height * ACTIONS * sizeof(QValue));
+        }
+    }
+    snapshot->agent = map.agent;
+    snapshot->epoch = map.epoch;
+    snapshot->steps = map.steps;
+    display->published = now;
+
+    // the release makes the snapshot visible to the GUI before its index
+    display->back = __atomic_exchange_n(&display->shared, display->back | SNAPSHOT_FRESH, __ATOMIC_ACQ_REL) & (SNAPSHOT_FRESH - 1);
+}
+
+Map *read_display(Display *display)
+{
+    if (__atomic_load_n(&display->shared, __ATOMIC_ACQUIRE) & SNAPSHOT_FRESH)
+    {
+        display->front = __atomic_exchange_n(&display->shared, display->front, __ATOMIC_ACQ_REL) & (SNAPSHOT_FRESH - 1);
+    }
+    return &display->snapshots[display->front];
+}
+
+int send_control(Display *display, enum Control control)
+{
+    unsigned sent = display->sent;
+    if (sent - __atomic_load_n(&display->received, __ATOMIC_ACQUIRE) >= CONTROL_QUEUE)
+    {
+        return 0;
+    }
+    display->controls[sent % CONTROL_QUEUE] = control;
+    __atomic_store_n(&display->sent, sent + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int receive_control(Display *display, enum Control *control)
+{
+    unsigned received = display->received;
+    if (received == __atomic_load_n(&display->sent, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+    *control = display->controls[received % CONTROL_QUEUE];
+    __atomic_store_n(&display->received, received + 1, __ATOMIC_RELEASE);
+    return 1;
+}
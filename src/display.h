@@ -0,0 +1,179 @@
+/**
+ * @file display.h
+ * @author Antoine Qiu
+ * @brief Definition of the snapshots and control messages exchanged between the trainer and the GUI
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <time.h>
+#include "q_learning.h"
+
+/**
+ * @brief Frames per second of the GUI, and snapshots per second published by the trainer
+ *
+ */
+#define DISPLAY_FPS 30
+/**
+ * @brief Maximum number of control messages waiting for the trainer
+ *
+ */
+#define CONTROL_QUEUE 16
+/**
+ * @brief Bit set on the shared snapshot index when the trainer published it after the GUI last took it
+ *
+ */
+#define SNAPSHOT_FRESH 4
+/**
+ * @brief Number of steps between two reads of the clock by the trainer, to keep publishing cheap at full speed
+ *
+ */
+#define PUBLISH_CHECK 256
+
+/**
+ * @brief Control messages sent by the GUI to the trainer
+ *
+ */
+enum Control
+{
+    /**
+     * @brief Toggle pause
+     *
+     */
+    CONTROL_PAUSE = 0,
+    /**
+     * @brief Toggle slow mode
+     *
+     */
+    CONTROL_SLOW = 1,
+    /**
+     * @brief Stop the training
+     *
+     */
+    CONTROL_QUIT = 2
+};
+
+/**
+ * @brief Structure shared by the trainer and the GUI threads
+ *
+ * The snapshots are triple buffered: the trainer writes its back snapshot then exchanges it with the shared one,
+ * the GUI exchanges its front snapshot with the shared one when a fresher one is there, so neither ever waits.
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Snapshots of the map, sharing the map buffers but each with its own copy of the Q-table
+     *
+     */
+    Map snapshots[3];
+    /**
+     * @brief Snapshot written by the trainer
+     *
+     */
+    int back;
+    /**
+     * @brief Snapshot exchanged between the threads, with SNAPSHOT_FRESH once published
+     *
+     */
+    int shared;
+    /**
+     * @brief Snapshot read by the GUI
+     *
+     */
+    int front;
+    /**
+     * @brief Whether the snapshots hold a copy of the Q-table
+     *
+     */
+    int copy_q;
+    /**
+     * @brief Monotonic time in nanoseconds of the last snapshot published
+     *
+     */
+    long long published;
+    /**
+     * @brief Number of calls to publish since the clock was last read
+     *
+     */
+    int calls;
+    /**
+     * @brief Control messages, in a ring written by the GUI and read by the trainer
+     *
+     */
+    int controls[CONTROL_QUEUE];
+    /**
+     * @brief Number of control messages sent
+     *
+     */
+    unsigned sent;
+    /**
+     * @brief Number of control messages received
+     *
+     */
+    unsigned received;
+    /**
+     * @brief Whether the trainer stopped
+     *
+     */
+    int done;
+} Display;
+
+/**
+ * @brief Initialize the snapshots with the current state of the map
+ *
+ * @param display Display to initialize
+ * @param map Map trained
+ * @param copy_q Copy the Q-table in the snapshots, only needed to show it
+ * @return int Status
+ */
+int init_display(Display *display, Map map, int copy_q);
+
+/**
+ * @brief Free the snapshots
+ *
+ * @param display Display to free
+ */
+void free_display(Display *display);
+
+/**
+ * @brief Publish a snapshot of the map if the last one is older than a frame, from the trainer
+ *
+ * @param display Display
+ * @param map Map trained
+ * @param force Publish even if the last snapshot is recent
+ */
+void publish_display(Display *display, Map map, int force);
+
+/**
+ * @brief Get the latest snapshot published, from the GUI
+ *
+ * @param display Display
+ * @return Map* Snapshot, valid until the next call
+ */
+Map *read_display(Display *display);
+
+/**
+ * @brief Send a control message to the trainer, from the GUI
+ *
+ * @param display Display
+ * @param control Control message
+ * @return int Status, 0 if the queue is full
+ */
+int send_control(Display *display, enum Control control);
+
+/**
+ * @brief Receive the next control message, from the trainer
+ *
+ * @param display Display
+ * @param control Control message received
+ * @return int Whether a message was received
+ */
+int receive_control(Display *display, enum Control *control);
+
+#endif
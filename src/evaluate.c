@@ -0,0 +1,409 @@
+/**
+ * @file evaluate.c
+ * @author Antoine Qiu
+ * @brief Implementation of the evaluation of the greedy policy from every starting cell
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "evaluate.h"
+
+/**
+ * @brief Check if the agent can stand on a cell, where it can start a rollout
+ *
+ * @param map Map
+ * @param cell Index of the cell
+ * @param teleporter Whether the teleporter is enabled, its entrances sending the agent to their exit
+ * @return int Status
+ */
+static int is_start(Map map, int cell, int teleporter)
+{
+    enum Type type = get_cell_type(map, cell);
+    return type != WALL && type != GOAL_1 && type != GOAL_2 && !(teleporter && type == TELEPORTER_1);
+}
+
+/**
+ * @brief Compare two integers, for qsort()
+ *
+ * @param a First integer
+ * @param b Second integer
+ * @return int Negative, zero or positive if a is lower, equal or greater than b
+ */
+static int compare_ints(const void *a, const void *b)
+{
+    return (*(const int *)a > *(const int *)b) - (*(const int *)a < *(const int *)b);
+}
+
+/**
+ * @brief Compute the shortest paths to each type of goal by a breadth-first search over the reversed transitions
+ *
+ * @param evaluator Evaluator with its transition table
+ * @param map Map
+ * @param teleporter Whether the teleporter is enabled
+ * @return int 1 if success, 0 otherwise
+ */
+static int find_distances(Evaluator *evaluator, Map map, int teleporter)
+{
+    int cells = map.width * map.height;
+    int *first = calloc(cells + 1, sizeof(int));
+    int *predecessors = malloc((size_t)cells * ACTIONS * sizeof(int));
+    int *queue = malloc(cells * sizeof(int));
+    if (first == NULL || predecessors == NULL || queue == NULL)
+    {
+        free(first);
+        free(predecessors);
+        free(queue);
+        return 0;
+    }
+
+    // the moves from each cell the agent can stand on are grouped by the cell they reach, bumps into walls and off the map excluded
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int cell = 0; cell < cells; cell++)
+        {
+            for (int action = 0; action < ACTIONS && is_start(map, cell, teleporter); action++)
+            {
+                int next = evaluator->transitions[(size_t)cell * ACTIONS + action].next;
+                if (next < 0 || next == cell || get_cell_type(map, next) == WALL)
+                {
+                    continue;
+                }
+                if (pass == 0)
+                {
+                    first[next + 1]++;
+                }
+                else
+                {
+                    predecessors[queue[next]++] = cell;
+                }
+            }
+        }
+        if (pass == 0)
+        {
+            for (int cell = 0; cell < cells; cell++)
+            {
+                first[cell + 1] += first[cell];
+                queue[cell] = first[cell];
+            }
+        }
+    }
+
+    // each search starts from every goal of its type at once
+    for (int goal = 0; goal < 2; goal++)
+    {
+        int *distances = evaluator->distances[goal];
+        int head = 0;
+        int tail = 0;
+        for (int cell = 0; cell < cells; cell++)
+        {
+            distances[cell] = get_cell_type(map, cell) == (goal == 0 ? GOAL_1 : GOAL_2) ? 0 : -1;
+            if (distances[cell] == 0)
+            {
+                queue[tail++] = cell;
+            }
+        }
+        while (head < tail)
+        {
+            int cell = queue[head++];
+            for (int i = first[cell]; i < first[cell + 1]; i++)
+            {
+                if (distances[predecessors[i]] < 0)
+                {
+                    distances[predecessors[i]] = distances[cell] + 1;
+                    queue[tail++] = predecessors[i];
+                }
+            }
+        }
+    }
+
+    free(first);
+    free(predecessors);
+    free(queue);
+    return 1;
+}
+
+/**
+ * @brief Start the thread pool of an evaluator, or leave it without pool if a thread fails to start
+ *
+ * @param evaluator Evaluator
+ * @param count Number of threads
+ */
+static void start_pool(Evaluator *evaluator, int count)
+{
+    evaluator->pool = malloc(count * sizeof(pthread_t));
+    if (evaluator->pool == NULL || pthread_barrier_init(&evaluator->barrier, NULL, count + 1) != 0)
+    {
+        free(evaluator->pool);
+        evaluator->pool = NULL;
+        return;
+    }
+    pthread_mutex_init(&evaluator->gate, NULL);
+    pthread_mutex_lock(&evaluator->gate);
+    int started = 0;
+    while (started < count && pthread_create(&evaluator->pool[started], NULL, run_eval_thread, evaluator) == 0)
+    {
+        started++;
+    }
+    evaluator->done = started < count;
+    pthread_mutex_unlock(&evaluator->gate);
+
+    // the threads already started stop at the gate, the calling thread then runs every rollout
+    if (evaluator->done)
+    {
+        for (int i = 0; i < started; i++)
+        {
+            pthread_join(evaluator->pool[i], NULL);
+        }
+        pthread_barrier_destroy(&evaluator->barrier);
+        pthread_mutex_destroy(&evaluator->gate);
+        free(evaluator->pool);
+        evaluator->pool = NULL;
+        evaluator->done = 0;
+        return;
+    }
+    evaluator->threads = count;
+}
+
+int init_evaluator(Evaluator *evaluator, Map map, Params params)
+{
+    *evaluator = (Evaluator){0};
+    int cells = map.width * map.height;
+    evaluator->seed = params.seed;
+
+    // the evaluator builds its own transition table, so that the training keeps stepping the way it was asked to
+    Map copy = map;
+    if (!build_transitions(&copy, params))
+    {
+        return 0;
+    }
+    evaluator->transitions = copy.transitions;
+    evaluator->distances[0] = malloc(cells * sizeof(int));
+    evaluator->distances[1] = malloc(cells * sizeof(int));
+    evaluator->starts = malloc(cells * sizeof(int));
+    if (evaluator->distances[0] == NULL || evaluator->distances[1] == NULL || evaluator->starts == NULL || !find_distances(evaluator, map, params.teleporter))
+    {
+        free_evaluator(evaluator);
+        return 0;
+    }
+
+    for (int cell = 0; cell < cells; cell++)
+    {
+        if (is_start(map, cell, params.teleporter))
+        {
+            evaluator->starts[evaluator->starts_count++] = cell;
+        }
+        int goal_1 = evaluator->distances[0][cell];
+        int goal_2 = evaluator->distances[1][cell];
+        int nearest = goal_1 < 0 || (goal_2 >= 0 && goal_2 < goal_1) ? goal_2 : goal_1;
+        if (EVAL_LIMIT * nearest > evaluator->limit)
+        {
+            evaluator->limit = EVAL_LIMIT * nearest;
+        }
+    }
+
+    // on large maps a sample of the starting cells is drawn once, so that successive evaluations compare the same rollouts
+    if (params.eval_starts > 0 && params.eval_starts < evaluator->starts_count)
+    {
+        Random random;
+        seed_random(&random, params.seed);
+        for (int i = 0; i < params.eval_starts; i++)
+        {
+            int j = i + random_int(&random, evaluator->starts_count - i);
+            int swap = evaluator->starts[i];
+            evaluator->starts[i] = evaluator->starts[j];
+            evaluator->starts[j] = swap;
+        }
+        evaluator->starts_count = params.eval_starts;
+        qsort(evaluator->starts, evaluator->starts_count, sizeof(int), compare_ints);
+    }
+
+    evaluator->steps = malloc((evaluator->starts_count > 0 ? evaluator->starts_count : 1) * sizeof(int));
+    evaluator->goals = malloc(evaluator->starts_count > 0 ? evaluator->starts_count : 1);
+    if (evaluator->steps == NULL || evaluator->goals == NULL)
+    {
+        free_evaluator(evaluator);
+        return 0;
+    }
+
+    // the calling thread claims chunks too, so a single chunk needs no pool
+    int chunks = (evaluator->starts_count + EVAL_CHUNK - 1) / EVAL_CHUNK;
+    int cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = (cores < chunks ? cores : chunks) - 1;
+    if (count > 0)
+    {
+        start_pool(evaluator, count);
+    }
+    return 1;
+}
+
+void free_evaluator(Evaluator *evaluator)
+{
+    // the pool waiting for the next evaluation is released to stop
+    if (evaluator->pool != NULL)
+    {
+        evaluator->done = 1;
+        pthread_barrier_wait(&evaluator->barrier);
+        for (int i = 0; i < evaluator->threads; i++)
+        {
+            pthread_join(evaluator->pool[i], NULL);
+        }
+        pthread_barrier_destroy(&evaluator->barrier);
+        pthread_mutex_destroy(&evaluator->gate);
+        free(evaluator->pool);
+    }
+    free(evaluator->transitions);
+    free(evaluator->distances[0]);
+    free(evaluator->distances[1]);
+    free(evaluator->starts);
+    free(evaluator->steps);
+    free(evaluator->goals);
+    *evaluator = (Evaluator){0};
+}
+
+/**
+ * @brief Follow a policy from a starting cell until a goal is reached or the step limit
+ *
+ * @param evaluator Evaluator
+ * @param policy Policy
+ * @param map Map containing the cell types
+ * @param start Starting cell
+ * @param goal Goal reached, 0 for a goal 1 and 1 for a goal 2
+ * @return int Number of steps, -1 if the step limit was reached
+ */
+static int roll_out(Evaluator *evaluator, Policy *policy, Map map, int start, unsigned char *goal)
+{
+    Random random;
+    seed_random(&random, evaluator->seed + start);
+    int cell = start;
+    for (int steps = 1; steps <= evaluator->limit; steps++)
+    {
+        Transition transition = evaluator->transitions[(size_t)cell * ACTIONS + policy_action(policy, &random, cell)];
+        if (transition.terminal)
+        {
+            *goal = get_cell_type(map, transition.next) != GOAL_1;
+            return steps;
+        }
+        if (transition.next >= 0 && get_cell_type(map, transition.next) != WALL)
+        {
+            cell = transition.next;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Roll out the chunks of starting cells claimed by a thread during an evaluation
+ *
+ * @param evaluator Evaluator, with the policy and the map of the evaluation
+ */
+static void roll_out_chunks(Evaluator *evaluator)
+{
+    for (int chunk = __atomic_fetch_add(&evaluator->next, 1, __ATOMIC_RELAXED); chunk * EVAL_CHUNK < evaluator->starts_count;
+         chunk = __atomic_fetch_add(&evaluator->next, 1, __ATOMIC_RELAXED))
+    {
+        int end = (chunk + 1) * EVAL_CHUNK < evaluator->starts_count ? (chunk + 1) * EVAL_CHUNK : evaluator->starts_count;
+        for (int i = chunk * EVAL_CHUNK; i < end; i++)
+        {
+            evaluator->steps[i] = roll_out(evaluator, evaluator->policy, evaluator->map, evaluator->starts[i], &evaluator->goals[i]);
+        }
+    }
+}
+
+void *run_eval_thread(void *arg)
+{
+    Evaluator *evaluator = arg;
+    pthread_mutex_lock(&evaluator->gate);
+    pthread_mutex_unlock(&evaluator->gate);
+    if (evaluator->done)
+    {
+        return NULL;
+    }
+    while (1)
+    {
+        pthread_barrier_wait(&evaluator->barrier);
+        if (evaluator->done)
+        {
+            break;
+        }
+        roll_out_chunks(evaluator);
+        pthread_barrier_wait(&evaluator->barrier);
+    }
+    return NULL;
+}
+
+int evaluate_policy(Evaluator *evaluator, Map map, Policy *policy, Evaluation *evaluation)
+{
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    int *sorted = malloc((evaluator->starts_count > 0 ? evaluator->starts_count : 1) * sizeof(int));
+    if (sorted == NULL)
+    {
+        return 0;
+    }
+
+    // the pool is released by the first barrier once the evaluation is set, and the second one waits for its last chunks
+    evaluator->policy = policy;
+    evaluator->map = map;
+    evaluator->next = 0;
+    if (evaluator->pool != NULL)
+    {
+        pthread_barrier_wait(&evaluator->barrier);
+    }
+    roll_out_chunks(evaluator);
+    if (evaluator->pool != NULL)
+    {
+        pthread_barrier_wait(&evaluator->barrier);
+    }
+
+    // the successful rollouts are sorted for the percentiles of their steps
+    *evaluation = (Evaluation){evaluator->starts_count, 0, 0, 0, -1, -1, -1, 0, 0};
+    long steps = 0;
+    long excess = 0;
+    for (int i = 0; i < evaluator->starts_count; i++)
+    {
+        if (evaluator->steps[i] < 0)
+        {
+            continue;
+        }
+        int distance = evaluator->distances[evaluator->goals[i]][evaluator->starts[i]];
+        sorted[evaluation->successes++] = evaluator->steps[i];
+        steps += evaluator->steps[i];
+        excess += evaluator->steps[i] - distance;
+        evaluation->optimal += evaluator->steps[i] == distance;
+    }
+    if (evaluation->successes > 0)
+    {
+        qsort(sorted, evaluation->successes, sizeof(int), compare_ints);
+        evaluation->mean = (double)steps / evaluation->successes;
+        evaluation->median = sorted[(evaluation->successes - 1) / 2];
+        evaluation->p90 = sorted[(evaluation->successes - 1) * 9 / 10];
+        evaluation->max = sorted[evaluation->successes - 1];
+        evaluation->excess = (double)excess / evaluation->successes;
+    }
+    gettimeofday(&end, NULL);
+    evaluation->time = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_usec - start.tv_usec) / 1e3;
+
+    free(sorted);
+    return 1;
+}
+
+int evaluate_q(Evaluator *evaluator, Map map, Evaluation *evaluation)
+{
+    Policy policy;
+    if (!compile_policy(&policy, map))
+    {
+        return 0;
+    }
+    int status = evaluate_policy(evaluator, map, &policy, evaluation);
+    free_policy(&policy);
+    return status;
+}
+
+void print_evaluation(Evaluation evaluation, int epoch)
+{
+    printf("Evaluation at epoch %d\t%d/%d starts reach a goal (%.1f%%)\tsteps mean %.2f median %d p90 %d max %d\texcess %.2f\t%d optimal\t%.3f ms\n", epoch,
+           evaluation.successes, evaluation.starts, evaluation.starts > 0 ? 100.0 * evaluation.successes / evaluation.starts : 0, evaluation.mean, evaluation.median,
+           evaluation.p90, evaluation.max, evaluation.excess, evaluation.optimal, evaluation.time);
+}
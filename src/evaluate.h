@@ -0,0 +1,233 @@
+/**
+ * @file evaluate.h
+ * @author Antoine Qiu
+ * @brief Definition of the evaluation of the greedy policy from every starting cell
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "q_learning.h"
+#include "params.h"
+#include "policy.h"
+
+/**
+ * @brief Number of starting cells claimed at once by an evaluation thread, and below which the evaluation runs on the calling thread
+ *
+ */
+#define EVAL_CHUNK 256
+/**
+ * @brief Step limit of a rollout as a multiple of the longest shortest path of the map, a rollout taking longer is stuck in a loop
+ *
+ */
+#define EVAL_LIMIT 4
+
+/**
+ * @brief Structure representing the evaluation of the policies of a map, built once and reused by every evaluation
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Transition table of the map, owned by the evaluator
+     *
+     */
+    Transition *transitions;
+    /**
+     * @brief Number of steps of the shortest path from each cell to a goal 1, then to a goal 2, -1 if no such goal can be reached
+     *
+     */
+    int *distances[2];
+    /**
+     * @brief Starting cells of the rollouts, every cell the agent can stand on or a sample of them
+     *
+     */
+    int *starts;
+    /**
+     * @brief Number of starting cells
+     *
+     */
+    int starts_count;
+    /**
+     * @brief Number of steps of each rollout of the last evaluation, -1 if it reached the step limit
+     *
+     */
+    int *steps;
+    /**
+     * @brief Goal reached by each rollout of the last evaluation, 0 for a goal 1 and 1 for a goal 2
+     *
+     */
+    unsigned char *goals;
+    /**
+     * @brief Step limit of a rollout, EVAL_LIMIT times the longest shortest path to the nearest goal, above which it counts as a loop
+     *
+     */
+    int limit;
+    /**
+     * @brief Seed of the random generators breaking the ties, one per starting cell so that results do not depend on the threads
+     *
+     */
+    uint64_t seed;
+    /**
+     * @brief Threads of the pool, started once with the evaluator and running the rollouts with the calling thread, NULL without pool
+     *
+     */
+    pthread_t *pool;
+    /**
+     * @brief Number of threads of the pool, one per core up to one per chunk of starting cells, minus the calling thread
+     *
+     */
+    int threads;
+    /**
+     * @brief Lock held while the pool is started, so that its threads stop before the first evaluation if one fails to start
+     *
+     */
+    pthread_mutex_t gate;
+    /**
+     * @brief Barrier of the pool and the calling thread at the start and at the end of each evaluation
+     *
+     */
+    pthread_barrier_t barrier;
+    /**
+     * @brief Whether the pool is stopping
+     *
+     */
+    int done;
+    /**
+     * @brief Policy followed by the rollouts of the current evaluation
+     *
+     */
+    Policy *policy;
+    /**
+     * @brief Map containing the cell types
+     *
+     */
+    Map map;
+    /**
+     * @brief Next chunk of starting cells to roll out
+     *
+     */
+    int next;
+} Evaluator;
+
+/**
+ * @brief Structure containing the results of an evaluation
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Number of rollouts, one per starting cell
+     *
+     */
+    int starts;
+    /**
+     * @brief Number of rollouts reaching a goal within the step limit
+     *
+     */
+    int successes;
+    /**
+     * @brief Number of rollouts reaching a goal by a shortest path to the type of goal they reach
+     *
+     */
+    int optimal;
+    /**
+     * @brief Mean number of steps of the successful rollouts
+     *
+     */
+    double mean;
+    /**
+     * @brief Median number of steps of the successful rollouts
+     *
+     */
+    int median;
+    /**
+     * @brief 90th percentile of the number of steps of the successful rollouts
+     *
+     */
+    int p90;
+    /**
+     * @brief Maximum number of steps of the successful rollouts
+     *
+     */
+    int max;
+    /**
+     * @brief Mean number of steps of the successful rollouts above the shortest path to the type of goal they reach
+     *
+     */
+    double excess;
+    /**
+     * @brief Duration of the evaluation in milliseconds
+     *
+     */
+    double time;
+} Evaluation;
+
+/**
+ * @brief Build the transition table and the shortest paths of the map, choose the starting cells and start the thread pool
+ *
+ * The shortest paths come from a breadth-first search from the goals of each type over the reversed transitions,
+ * so that a rollout heading to a farther goal 1 is measured against the goals 1 rather than the nearest goal 2.
+ * The agent can start on any cell but walls, goals and teleporter entrances with the teleporter enabled.
+ * The pool waits between evaluations, so that frequent evaluations do not pay the start-up of their threads.
+ * The evaluator must not move once initialized, its threads point to it.
+ *
+ * @param evaluator Evaluator to initialize
+ * @param map Map
+ * @param params Parameters, with the number of sampled starting cells, 0 for all of them
+ * @return int 1 if success, 0 otherwise
+ */
+int init_evaluator(Evaluator *evaluator, Map map, Params params);
+
+/**
+ * @brief Stop the thread pool and free an evaluator
+ *
+ * @param evaluator Evaluator
+ */
+void free_evaluator(Evaluator *evaluator);
+
+/**
+ * @brief Roll out the chunks of starting cells claimed by a thread of the pool at each evaluation, until the evaluator is freed
+ *
+ * @param arg Evaluator
+ * @return void* NULL
+ */
+void *run_eval_thread(void *arg);
+
+/**
+ * @brief Roll out a policy from every starting cell, in parallel on large maps
+ *
+ * @param evaluator Evaluator
+ * @param map Map the policy was compiled for
+ * @param policy Policy
+ * @param evaluation Results
+ * @return int 1 if success, 0 otherwise
+ */
+int evaluate_policy(Evaluator *evaluator, Map map, Policy *policy, Evaluation *evaluation);
+
+/**
+ * @brief Compile the greedy policy of the Q-table of a map and evaluate it
+ *
+ * @param evaluator Evaluator
+ * @param map Map containing the Q-table
+ * @param evaluation Results
+ * @return int 1 if success, 0 otherwise
+ */
+int evaluate_q(Evaluator *evaluator, Map map, Evaluation *evaluation);
+
+/**
+ * @brief Print the results of an evaluation on one line
+ *
+ * @param evaluation Results
+ * @param epoch Epoch of the evaluated policy
+ */
+void print_evaluation(Evaluation evaluation, int epoch);
+
+#endif
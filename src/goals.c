@@ -0,0 +1,259 @@
+/**
+ * @file goals.c
+ * @author Antoine Qiu
+ * @brief Implementation of the goal-conditioned training of one Q-table per goal
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "goals.h"
+
+int init_goals(Goals *goals, Map map, Params params)
+{
+    *goals = (Goals){0};
+    goals->count = params.goals_count;
+    goals->cells = malloc(params.goals_count * sizeof(int));
+    goals->q = calloc((size_t)map.width * map.height * params.goals_count * ACTIONS, sizeof(QValue));
+    if (goals->cells == NULL || goals->q == NULL)
+    {
+        printf("Failed to allocate goal Q-tables\n");
+        free_goals(*goals);
+        return 0;
+    }
+    for (int i = 0; i < params.goals_count; i++)
+    {
+        State state = {params.goals[i].x, params.goals[i].y};
+        if (!check_state(map, state) || get_type(map, state) == WALL)
+        {
+            printf("Goal %d at (%d, %d) is not a free cell of the map\n", i + 1, state.x, state.y);
+            free_goals(*goals);
+            return 0;
+        }
+        goals->cells[i] = get_cell(map, state);
+    }
+    return 1;
+}
+
+void free_goals(Goals goals)
+{
+    free(goals.cells);
+    free(goals.q);
+}
+
+/**
+ * @brief Get the Q-values of a goal in a cell
+ *
+ * @param goals Goals
+ * @param cell Index of the cell
+ * @param goal Index of the goal
+ * @return QValue* Q-values of the actions
+ */
+static inline QValue *goal_row(Goals *goals, int cell, int goal)
+{
+    return &goals->q[((size_t)cell * goals->count + goal) * ACTIONS];
+}
+
+/**
+ * @brief Find the maximum Q-value of a goal in a cell, like max_q_cell()
+ *
+ * @param row Q-values of the actions
+ * @return double Maximum Q-value
+ */
+static inline double max_goal(QValue *row)
+{
+    double best = from_q_value(row[UP]);
+    for (int i = 1; i < ACTIONS; i++)
+    {
+        double value = from_q_value(row[i]);
+        if (value > best)
+        {
+            best = value;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Add an update of a goal Q-table to the running reduction of the updates, like track_update()
+ *
+ * @param deltas Running reduction
+ * @param row Q-values of the actions, after the update
+ * @param actions Bitmask of the possible actions of the cell
+ * @param action Updated action
+ * @param old Q-value before the update
+ * @param tolerance Tolerance of the convergence
+ */
+static inline void track_goal(Deltas *deltas, QValue *row, int actions, enum Action action, double old, double tolerance)
+{
+    double value = from_q_value(row[action]);
+    double delta = fabs(value - old);
+    deltas->max = delta > deltas->max ? delta : deltas->max;
+    deltas->sum += delta;
+    deltas->updates++;
+
+    double other = -INFINITY;
+    for (int i = 0; i < ACTIONS; i++)
+    {
+        if (i != (int)action && actions & 1 << i && from_q_value(row[i]) > other)
+        {
+            other = from_q_value(row[i]);
+        }
+    }
+    deltas->changes += (old >= other - tolerance) != (value >= other - tolerance);
+}
+
+/**
+ * @brief Choose the next action with the Q-table of a goal, like choose_action()
+ *
+ * @param map Map containing the random generator
+ * @param row Q-values of the actions for the goal the agent heads to
+ * @param actions Bitmask of the possible actions of the cell
+ * @param params Parameters
+ * @return enum Action Action
+ */
+static enum Action choose_goal_action(Map *map, QValue *row, int actions, Params params)
+{
+    INSTRUMENT_START(select_start);
+    INSTRUMENT_COUNT(STEPS, 1);
+    int votes = 0;
+    double max = 0;
+    for (int i = 0; i < ACTIONS; i++)
+    {
+        if (!(actions & 1 << i))
+        {
+            continue;
+        }
+        double value = from_q_value(row[i]);
+        if (votes == 0 || value > max)
+        {
+            max = value;
+            votes = 1 << i;
+        }
+        else if (value == max)
+        {
+            votes |= 1 << i;
+        }
+    }
+    enum Action action = pick_action(&map->random, votes);
+    INSTRUMENT_STOP(select_start, SELECT);
+
+    INSTRUMENT_START(explore_start);
+    action = epsilon_greedy(&map->random, action, actions, params.epsilon);
+    INSTRUMENT_STOP(explore_start, EXPLORE);
+    return action;
+}
+
+/**
+ * @brief Update the Q-tables of all the goals with a transition, each with the reward of its own goal
+ *
+ * @param map Map
+ * @param goals Goals
+ * @param cell Index of the cell of the transition
+ * @param action Action of the transition
+ * @param next Index of the cell reached
+ * @param wall Whether the action bumped into a wall
+ * @param params Parameters
+ */
+static void update_goals(Map *map, Goals *goals, int cell, enum Action action, int next, int wall, Params params)
+{
+    INSTRUMENT_START(update_start);
+    QValue *row = goal_row(goals, cell, 0);
+    QValue *next_row = goal_row(goals, next, 0);
+    for (int goal = 0; goal < goals->count; goal++, row += ACTIONS, next_row += ACTIONS)
+    {
+        // a goal ends the episodes of its own table, so its Q-values there stay at 0 as in single goal training
+        if (cell == goals->cells[goal])
+        {
+            continue;
+        }
+        int reward = wall ? WALL : next == goals->cells[goal] ? GOAL_REWARD : EMPTY;
+        double old = from_q_value(row[action]);
+        row[action] = to_q_value((1 - params.alpha) * old + params.alpha * (reward + params.gamma * max_goal(next_row)));
+        if (params.tolerance > 0)
+        {
+            track_goal(&map->deltas, row, map->actions[cell], action, old, params.tolerance);
+        }
+    }
+    INSTRUMENT_STOP(update_start, UPDATE);
+}
+
+void train_goals(Map *map, Goals *goals, Params params, int *running, Convergence *convergence)
+{
+    int target = 0;
+    int time = 0;
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    (*map).agent = (*map).start;
+
+    while (__atomic_load_n(running, __ATOMIC_RELAXED) && convergence->epoch < 0 && (params.epochs < 0 || (*map).epoch < params.epochs))
+    {
+        int cell = get_cell(*map, (*map).agent);
+        enum Action action = choose_goal_action(map, goal_row(goals, cell, target), (*map).actions[cell], params);
+        int reward;
+        State next_state = step_state(map, (*map).agent, action, params, &reward);
+        int wall = get_type(*map, next_state) == WALL;
+        update_goals(map, goals, cell, action, get_cell(*map, next_state), wall, params);
+        if (!wall)
+        {
+            (*map).agent = next_state;
+        }
+        (*map).steps++;
+
+        // check if the goal the agent heads to is reached
+        if (get_cell(*map, (*map).agent) != goals->cells[target])
+        {
+            continue;
+        }
+        gettimeofday(&end, NULL);
+        time = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+
+        // the agent heads to the next goal from there, and goes back to the start after the last one
+        int reached = target;
+        target = (target + 1) % goals->count;
+        if (target == 0)
+        {
+            (*map).agent = (*map).start;
+        }
+        (*map).epoch++;
+        if (params.tolerance > 0)
+        {
+            check_convergence(convergence, &(*map).deltas, params, (*map).epoch, 1);
+        }
+
+        // print epoch info
+        if (params.print && params.tolerance > 0)
+        {
+            printf("Epoch %d/%d\tgoal %d\t%d steps\t%d ms\tmax dQ %g\tmean dQ %g\t%ld greedy changes\n", (*map).epoch, params.epochs, reached + 1, (*map).steps, time,
+                   convergence->last.max, convergence->last.updates > 0 ? convergence->last.sum / convergence->last.updates : 0, convergence->last.changes);
+        }
+        else if (params.print)
+        {
+            printf("Epoch %d/%d\tgoal %d\t%d steps\t%d ms\n", (*map).epoch, params.epochs, reached + 1, (*map).steps, time);
+        }
+        (*map).steps = 0;
+        gettimeofday(&start, NULL);
+    }
+}
+
+int save_goal(Map map, Goals goals, int goal, char *filename)
+{
+    // the Q-values of the goal are gathered into a Q-table of their own, saved like any other
+    size_t cells = (size_t)map.width * map.height;
+    QValue *q = malloc(cells * ACTIONS * sizeof(QValue));
+    if (q == NULL)
+    {
+        return 0;
+    }
+    for (size_t cell = 0; cell < cells; cell++)
+    {
+        memcpy(&q[cell * ACTIONS], goal_row(&goals, cell, goal), ACTIONS * sizeof(QValue));
+    }
+    map.q = q;
+    map.sparse = NULL;
+    map.mapping = NULL;
+    int status = save_q(map, filename);
+    free(q);
+    return status;
+}
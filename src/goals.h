@@ -0,0 +1,92 @@
+/**
+ * @file goals.h
+ * @author Antoine Qiu
+ * @brief Definition of the goal-conditioned training of one Q-table per goal
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef GOALS_H
+#define GOALS_H
+
+#include <stdio.h>
+#include <sys/time.h>
+#include "q_learning.h"
+#include "params.h"
+#include "convergence.h"
+
+/**
+ * @brief Reward of reaching the goal of a table, the one of goal 1 so that the tables match the ones of loop/
+ *
+ */
+#define GOAL_REWARD GOAL_1
+
+/**
+ * @brief Structure representing the Q-tables of several goals trained together
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Number of goals
+     *
+     */
+    int count;
+    /**
+     * @brief Cell of each goal
+     *
+     */
+    int *cells;
+    /**
+     * @brief Q-tables of shape (height, width, goal, action), the Q-values of all the goals of a cell next to each other
+     *
+     */
+    QValue *q;
+} Goals;
+
+/**
+ * @brief Allocate the Q-tables of the goals given in the parameters, all Q-values at 0
+ *
+ * @param goals Goals to initialize
+ * @param map Map
+ * @param params Parameters, with the goals
+ * @return int 1 if success, 0 otherwise
+ */
+int init_goals(Goals *goals, Map map, Params params);
+
+/**
+ * @brief Free the Q-tables of the goals
+ *
+ * @param goals Goals
+ */
+void free_goals(Goals goals);
+
+/**
+ * @brief Train the Q-tables of all the goals from a single agent
+ *
+ * The agent heads to each goal in turn, acting with the Q-table of that goal, and goes back to the start after the last one.
+ * Every transition it observes updates the Q-tables of all the goals, each with its own reward, so each table learns off-policy
+ * from the moves made for the others. An epoch ends when the agent reaches the goal it heads to.
+ *
+ * @param map Map, its Q-table is not used
+ * @param goals Goals
+ * @param params Parameters
+ * @param running Running state, training stops when set to 0
+ * @param convergence Convergence state, updated at the end of each epoch with a tolerance
+ */
+void train_goals(Map *map, Goals *goals, Params params, int *running, Convergence *convergence);
+
+/**
+ * @brief Save the Q-table of a goal, in the format of save_q()
+ *
+ * @param map Map
+ * @param goals Goals
+ * @param goal Index of the goal
+ * @param filename File to write
+ * @return int 1 if success, 0 otherwise
+ */
+int save_goal(Map map, Goals goals, int goal, char *filename);
+
+#endif
@@ -35,6 +35,81 @@ SDL_Renderer *q_renderer = NULL;
  *
  */
 TTF_Font *font = NULL;
+/**
+ * @brief Texture with the characters of GLYPHS drawn in white side by side
+ *
+ */
+SDL_Texture *glyph_atlas = NULL;
+/**
+ * @brief Position of each character of GLYPHS in the glyph atlas
+ *
+ */
+SDL_Rect glyph_rects[GLYPH_COUNT];
+/**
+ * @brief Texture keeping the drawn Q-table between frames
+ *
+ */
+SDL_Texture *q_texture = NULL;
+/**
+ * @brief Q-values drawn in the Q-table texture, NaN for the cells not drawn yet
+ *
+ */
+double *shown_q = NULL;
+
+/**
+ * @brief Render each character of GLYPHS once and gather them in the glyph atlas
+ *
+ * @return int Status
+ */
+static int build_glyph_atlas()
+{
+    SDL_Texture *glyphs[GLYPH_COUNT] = {NULL};
+    int width = 0, height = 0;
+    int status = 1;
+    for (size_t i = 0; i < GLYPH_COUNT && status; i++)
+    {
+        char text[2] = {GLYPHS[i], '\0'};
+        SDL_Surface *surface = TTF_RenderText_Blended(font, text, (SDL_Color){255, 255, 255, 255});
+        glyphs[i] = surface != NULL ? SDL_CreateTextureFromSurface(q_renderer, surface) : NULL;
+        SDL_FreeSurface(surface);
+        status = glyphs[i] != NULL;
+        if (status)
+        {
+            SDL_QueryTexture(glyphs[i], NULL, NULL, &glyph_rects[i].w, &glyph_rects[i].h);
+            glyph_rects[i].x = width;
+            glyph_rects[i].y = 0;
+            width += glyph_rects[i].w;
+            height = glyph_rects[i].h > height ? glyph_rects[i].h : height;
+        }
+    }
+
+    // the glyphs are white on a transparent background, so that they can be tinted when copied
+    if (status)
+    {
+        glyph_atlas = SDL_CreateTexture(q_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width, height);
+        status = glyph_atlas != NULL;
+    }
+    if (status)
+    {
+        SDL_SetTextureBlendMode(glyph_atlas, SDL_BLENDMODE_BLEND);
+        SDL_SetRenderTarget(q_renderer, glyph_atlas);
+        SDL_SetRenderDrawColor(q_renderer, 0, 0, 0, 0);
+        SDL_RenderClear(q_renderer);
+        for (size_t i = 0; i < GLYPH_COUNT; i++)
+        {
+            SDL_RenderCopy(q_renderer, glyphs[i], NULL, &glyph_rects[i]);
+        }
+        SDL_SetRenderTarget(q_renderer, NULL);
+    }
+    for (size_t i = 0; i < GLYPH_COUNT; i++)
+    {
+        if (glyphs[i] != NULL)
+        {
+            SDL_DestroyTexture(glyphs[i]);
+        }
+    }
+    return status;
+}
 
 int init_gui_map(Map map)
 {
@@ -81,7 +156,7 @@ int init_gui_q(Map map)
     }
     if (q_renderer == NULL)
     {
-        q_renderer = SDL_CreateRenderer(q_window, -1, SDL_RENDERER_ACCELERATED);
+        q_renderer = SDL_CreateRenderer(q_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
     }
 
     if (!TTF_WasInit())
@@ -97,6 +172,25 @@ int init_gui_q(Map map)
     {
         return 0;
     }
+
+    if (glyph_atlas == NULL && !build_glyph_atlas())
+    {
+        return 0;
+    }
+    if (q_texture == NULL)
+    {
+        q_texture = SDL_CreateTexture(q_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, map.width * CELL_SIZE, map.height * CELL_SIZE);
+        free(shown_q);
+        shown_q = malloc((size_t)map.width * map.height * ACTIONS * sizeof(double));
+        if (q_texture == NULL || shown_q == NULL)
+        {
+            return 0;
+        }
+        for (size_t i = 0; i < (size_t)map.width * map.height * ACTIONS; i++)
+        {
+            shown_q[i] = NAN;
+        }
+    }
     return 1;
 }
 
@@ -111,7 +205,7 @@ void show_map(Map map)
             SDL_Rect rect = {j * CELL_SIZE, i * CELL_SIZE, CELL_SIZE, CELL_SIZE};
             SDL_Rect small_rect = {j * CELL_SIZE + CELL_SIZE / 4, i * CELL_SIZE + CELL_SIZE / 4, CELL_SIZE / 2, CELL_SIZE / 2};
 
-            switch (map.map[i][j])
+            switch (get_cell_type(map, get_cell(map, (State){j, i})))
             {
             case EMPTY:
                 SDL_SetRenderDrawColor(map_renderer, 255, 255, 255, 255);
@@ -143,25 +237,99 @@ void show_map(Map map)
     SDL_RenderPresent(map_renderer);
 }
 
+/**
+ * @brief Get the color of a Q-value, from red for walls to green for goals
+ *
+ * @param value Q-value
+ * @return SDL_Color Color
+ */
+static SDL_Color q_color(double value)
+{
+    if (value <= -10)
+    {
+        return (SDL_Color){255, 0, 0, 255};
+    }
+    else if (value < 0)
+    {
+        return (SDL_Color){255 * 0.25 + (255 * 0.75) * (-value / 10), 0, 0, 255};
+    }
+    else if (value == 0)
+    {
+        return (SDL_Color){255, 255, 255, 255};
+    }
+    else if (value >= 1000)
+    {
+        return (SDL_Color){0, 255, 0, 255};
+    }
+    return (SDL_Color){0, 255 * 0.25 + (255 * 0.75) * (value / 1000), 0, 255};
+}
+
+/**
+ * @brief Draw a number with the glyph atlas, stretched over a rectangle like a rendered text
+ *
+ * @param text Number to draw, characters missing from GLYPHS are skipped
+ * @param color Color of the number
+ * @param rect Rectangle covered by the number
+ */
+static void draw_number(const char *text, SDL_Color color, SDL_Rect rect)
+{
+    const SDL_Rect *glyphs[16];
+    int count = 0;
+    int width = 0;
+    for (; *text != '\0' && count < 16; text++)
+    {
+        const char *glyph = strchr(GLYPHS, *text);
+        if (glyph != NULL)
+        {
+            glyphs[count] = &glyph_rects[glyph - GLYPHS];
+            width += glyphs[count++]->w;
+        }
+    }
+
+    // each glyph gets the share of the rectangle its width has in the text
+    SDL_SetTextureColorMod(glyph_atlas, color.r, color.g, color.b);
+    int offset = 0;
+    for (int i = 0; i < count && width > 0; i++)
+    {
+        int x0 = rect.x + rect.w * offset / width;
+        offset += glyphs[i]->w;
+        int x1 = rect.x + rect.w * offset / width;
+        SDL_Rect target = {x0, rect.y, x1 - x0, rect.h};
+        SDL_RenderCopy(q_renderer, glyph_atlas, glyphs[i], &target);
+    }
+}
+
 void show_q(Map map)
 {
-    SDL_SetRenderDrawColor(q_renderer, 0, 0, 0, 255);
-    SDL_RenderClear(q_renderer);
-    SDL_Surface *surface;
-    SDL_Texture *texture;
-    char text[10];
+    char text[16];
     int size = CELL_SIZE / 3;
     SDL_Rect rect, action;
 
+    // the Q-table texture keeps the cells drawn in the previous frames
+    SDL_SetRenderTarget(q_renderer, q_texture);
     for (int i = 0; i < map.height; i++)
     {
         for (int j = 0; j < map.width; j++)
         {
+            int cell = i * map.width + j;
+            int changed = 0;
+            for (int k = 0; k < ACTIONS; k++)
+            {
+                // NaN never compares equal, so the cells never drawn are drawn
+                changed |= get_q(map, cell, k) != shown_q[(size_t)cell * ACTIONS + k];
+            }
+            if (!changed)
+            {
+                continue;
+            }
+
             rect = (SDL_Rect){j * CELL_SIZE, i * CELL_SIZE, CELL_SIZE, CELL_SIZE};
+            SDL_SetRenderDrawColor(q_renderer, 0, 0, 0, 255);
+            SDL_RenderFillRect(q_renderer, &rect);
             SDL_SetRenderDrawColor(q_renderer, 255, 255, 255, 255);
             SDL_RenderDrawRect(q_renderer, &rect);
 
-            for (int k = 0; k < 4; k++)
+            for (int k = 0; k < ACTIONS; k++)
             {
                 switch (k)
                 {
@@ -178,38 +346,16 @@ void show_q(Map map)
                     action = (SDL_Rect){j * CELL_SIZE + size * 2, i * CELL_SIZE + size, size, size};
                     break;
                 }
-                SDL_Color color;
-                double value = map.q[i][j][k];
-                if (value <= -10)
-                {
-                    color = (SDL_Color){255, 0, 0, 255};
-                }
-                else if (value < 0)
-                {
-                    color = (SDL_Color){255 * 0.25 + (255 * 0.75) * (-value / 10), 0, 0, 255};
-                }
-                else if (value == 0)
-                {
-                    color = (SDL_Color){255, 255, 255, 255};
-                }
-                else if (value >= 1000)
-                {
-                    color = (SDL_Color){0, 255, 0, 255};
-                }
-                else
-                {
-                    color = (SDL_Color){0, 255 * 0.25 + (255 * 0.75) * (value / 1000), 0, 255};
-                }
-                sprintf(text, "%.1f", value);
-                surface = TTF_RenderText_Solid(font, text, color);
-                texture = SDL_CreateTextureFromSurface(q_renderer, surface);
-                SDL_RenderCopy(q_renderer, texture, NULL, &action);
-                SDL_FreeSurface(surface);
-                SDL_DestroyTexture(texture);
+                double value = get_q(map, cell, k);
+                shown_q[(size_t)cell * ACTIONS + k] = value;
+                snprintf(text, sizeof(text), "%.1f", value);
+                draw_number(text, q_color(value), action);
             }
         }
     }
+    SDL_SetRenderTarget(q_renderer, NULL);
 
+    SDL_RenderCopy(q_renderer, q_texture, NULL, NULL);
     SDL_RenderPresent(q_renderer);
 }
 
@@ -225,6 +371,18 @@ void destroy_gui()
         SDL_DestroyWindow(map_window);
         map_window = NULL;
     }
+    if (glyph_atlas != NULL)
+    {
+        SDL_DestroyTexture(glyph_atlas);
+        glyph_atlas = NULL;
+    }
+    if (q_texture != NULL)
+    {
+        SDL_DestroyTexture(q_texture);
+        q_texture = NULL;
+    }
+    free(shown_q);
+    shown_q = NULL;
     if (q_renderer != NULL)
     {
         SDL_DestroyRenderer(q_renderer);
@@ -20,6 +20,16 @@
  *
  */
 #define CELL_SIZE 100
+/**
+ * @brief Characters of the glyph atlas, the only ones needed to write Q-values
+ *
+ */
+#define GLYPHS "0123456789.-"
+/**
+ * @brief Number of characters of the glyph atlas
+ *
+ */
+#define GLYPH_COUNT (sizeof(GLYPHS) - 1)
 
 /**
  * @brief Initialize the GUI to show the map
@@ -29,7 +39,7 @@
  */
 int init_gui_map(Map map);
 /**
- * @brief Initialize the GUI to show the Q-table
+ * @brief Initialize the GUI to show the Q-table, with the glyph atlas and the texture keeping the drawn Q-table
  *
  * @param map Map containing various information for initialization
  * @return int Status
@@ -44,6 +54,8 @@ void show_map(Map map);
 /**
  * @brief Show the Q-table on the screen
  *
+ * Only the cells whose Q-values changed since the last call are drawn again, with numbers made of glyphs of the atlas.
+ *
  * @param map Map containing the Q-table to show
  */
 void show_q(Map map);
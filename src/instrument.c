@@ -0,0 +1,269 @@
+/**
+ * @file instrument.c
+ * @author Antoine Qiu
+ * @brief Implementation of the hot path instrumentation
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "instrument.h"
+
+__thread Counters *thread_counters = NULL;
+
+#ifdef INSTRUMENT
+/**
+ * @brief Names of the phases
+ *
+ */
+static const char *phase_names[] = {"select", "explore", "reward", "update", "render", "poll"};
+/**
+ * @brief Names of the events
+ *
+ */
+static const char *event_names[] = {"steps", "random_actions", "wall_bumps", "teleports", "off_map"};
+
+/**
+ * @brief Counters of all the registered threads
+ *
+ */
+static Counters *registered = NULL;
+/**
+ * @brief Number of registered threads
+ *
+ */
+static int registered_count = 0;
+/**
+ * @brief Lock of the registered threads and of the reporter state
+ *
+ */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * @brief Signaled to stop the reporter thread
+ *
+ */
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+/**
+ * @brief Reporter thread
+ *
+ */
+static pthread_t reporter;
+/**
+ * @brief Interval of the reporter thread in seconds, 0 if not started
+ *
+ */
+static int interval = 0;
+/**
+ * @brief Whether the reporter thread must stop
+ *
+ */
+static int stop = 0;
+/**
+ * @brief Ticks at the start of the instrumentation
+ *
+ */
+static uint64_t start_ticks = 0;
+/**
+ * @brief Monotonic time in nanoseconds at the start of the instrumentation
+ *
+ */
+static uint64_t start_ns = 0;
+
+/**
+ * @brief Get the monotonic time in nanoseconds
+ *
+ * @return uint64_t Time
+ */
+static uint64_t read_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+Counters *register_counters()
+{
+    Counters *counters = aligned_alloc(64, sizeof(Counters));
+    if (counters == NULL)
+    {
+        // nothing sensible to do on the hot path, the process is out of memory
+        abort();
+    }
+    *counters = (Counters){0};
+    pthread_mutex_lock(&mutex);
+    counters->next = registered;
+    registered = counters;
+    registered_count++;
+    pthread_mutex_unlock(&mutex);
+    thread_counters = counters;
+    return counters;
+}
+
+/**
+ * @brief Sum the counters of all the registered threads
+ *
+ * @param total Sum of the counters
+ */
+static void sum_counters(Counters *total)
+{
+    *total = (Counters){0};
+    pthread_mutex_lock(&mutex);
+    for (Counters *counters = registered; counters != NULL; counters = counters->next)
+    {
+        for (int i = 0; i < PHASES; i++)
+        {
+            total->ticks[i] += __atomic_load_n(&counters->ticks[i], __ATOMIC_RELAXED);
+            total->calls[i] += __atomic_load_n(&counters->calls[i], __ATOMIC_RELAXED);
+        }
+        for (int i = 0; i < EVENTS; i++)
+        {
+            total->events[i] += __atomic_load_n(&counters->events[i], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @brief Get the number of nanoseconds per tick since the start
+ *
+ * @return double Nanoseconds per tick
+ */
+static double ns_per_tick()
+{
+    uint64_t ticks = read_ticks() - start_ticks;
+    return ticks > 0 ? (double)(read_ns() - start_ns) / ticks : 1;
+}
+
+/**
+ * @brief Print the counters of all the threads as one JSON line
+ *
+ * @param file Output file
+ */
+static void print_json(FILE *file)
+{
+    Counters total;
+    sum_counters(&total);
+    double scale = ns_per_tick();
+    fprintf(file, "{\"elapsed_ns\": %llu, \"threads\": %d", (unsigned long long)(read_ns() - start_ns), registered_count);
+    for (int i = 0; i < PHASES; i++)
+    {
+        fprintf(file, ", \"%s_calls\": %llu, \"%s_ticks\": %llu, \"%s_ns\": %.0f", phase_names[i], (unsigned long long)total.calls[i],
+                phase_names[i], (unsigned long long)total.ticks[i], phase_names[i], total.ticks[i] * scale);
+    }
+    for (int i = 0; i < EVENTS; i++)
+    {
+        fprintf(file, ", \"%s\": %llu", event_names[i], (unsigned long long)total.events[i]);
+    }
+    fprintf(file, "}\n");
+    fflush(file);
+}
+
+/**
+ * @brief Print the counters periodically until stopped
+ *
+ * @param arg Unused
+ * @return void* NULL
+ */
+static void *run_reporter(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&mutex);
+    while (!stop)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += interval;
+        pthread_cond_timedwait(&cond, &mutex, &deadline);
+        if (!stop)
+        {
+            // sum_counters takes the lock itself
+            pthread_mutex_unlock(&mutex);
+            print_json(stderr);
+            pthread_mutex_lock(&mutex);
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+#endif
+
+int start_instrument(int seconds)
+{
+#ifdef INSTRUMENT
+    start_ticks = read_ticks();
+    start_ns = read_ns();
+    if (seconds > 0)
+    {
+        interval = seconds;
+        stop = 0;
+        if (pthread_create(&reporter, NULL, run_reporter, NULL) != 0)
+        {
+            interval = 0;
+            return 0;
+        }
+    }
+#else
+    if (seconds > 0)
+    {
+        printf("Instrumentation is compiled out, rebuild with make INSTRUMENT=1\n");
+    }
+#endif
+    return 1;
+}
+
+void stop_instrument()
+{
+#ifdef INSTRUMENT
+    if (interval > 0)
+    {
+        pthread_mutex_lock(&mutex);
+        stop = 1;
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(reporter, NULL);
+        interval = 0;
+    }
+
+    Counters total;
+    sum_counters(&total);
+    double scale = ns_per_tick();
+    uint64_t timed = 0;
+    for (int i = 0; i < PHASES; i++)
+    {
+        timed += total.ticks[i];
+    }
+
+    printf("\nInstrumentation (%d threads, %.3f s)\n", registered_count, (read_ns() - start_ns) / 1e9);
+    printf("%-8s %14s %16s %14s %10s %7s\n", "phase", "calls", "ticks", "ms", "ns/call", "share");
+    for (int i = 0; i < PHASES; i++)
+    {
+        printf("%-8s %14llu %16llu %14.1f %10.1f %6.1f%%\n", phase_names[i], (unsigned long long)total.calls[i], (unsigned long long)total.ticks[i],
+               total.ticks[i] * scale / 1e6, total.calls[i] > 0 ? total.ticks[i] * scale / total.calls[i] : 0, timed > 0 ? 100.0 * total.ticks[i] / timed : 0);
+    }
+    for (int i = 0; i < EVENTS; i++)
+    {
+        printf("%-16s %14llu\n", event_names[i], (unsigned long long)total.events[i]);
+    }
+
+    // per thread steps show the balance of parallel training
+    if (registered_count > 1)
+    {
+        int thread = registered_count;
+        for (Counters *counters = registered; counters != NULL; counters = counters->next)
+        {
+            printf("thread %d steps  %14llu\n", --thread, (unsigned long long)counters->events[STEPS]);
+        }
+    }
+
+    while (registered != NULL)
+    {
+        Counters *next = registered->next;
+        free(registered);
+        registered = next;
+    }
+    registered_count = 0;
+    thread_counters = NULL;
+#endif
+}
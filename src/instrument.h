@@ -0,0 +1,226 @@
+/**
+ * @file instrument.h
+ * @author Antoine Qiu
+ * @brief Definition of the hot path instrumentation, compiled in with -DINSTRUMENT (make INSTRUMENT=1)
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Timed phases
+ *
+ */
+enum Phase
+{
+    /**
+     * @brief Greedy action selection in q()
+     *
+     */
+    SELECT = 0,
+    /**
+     * @brief Exploration in epsilon_greedy()
+     *
+     */
+    EXPLORE = 1,
+    /**
+     * @brief Move, teleport and reward in q()
+     *
+     */
+    REWARD = 2,
+    /**
+     * @brief Q-table update in q()
+     *
+     */
+    UPDATE = 3,
+    /**
+     * @brief show_map() and show_q()
+     *
+     */
+    RENDER = 4,
+    /**
+     * @brief SDL_PollEvent() loop
+     *
+     */
+    POLL = 5,
+    /**
+     * @brief Number of phases
+     *
+     */
+    PHASES = 6
+};
+
+/**
+ * @brief Counted events
+ *
+ */
+enum Event
+{
+    /**
+     * @brief Agent steps
+     *
+     */
+    STEPS = 0,
+    /**
+     * @brief Actions drawn by exploration
+     *
+     */
+    RANDOM_ACTIONS = 1,
+    /**
+     * @brief Moves into a wall
+     *
+     */
+    WALL_BUMPS = 2,
+    /**
+     * @brief Moves through a teleporter
+     *
+     */
+    TELEPORTS = 3,
+    /**
+     * @brief Moves leaving the map, the agent staying in place, 0 unless a cell has no possible action since the action masks keep the agent inside
+     *
+     */
+    OFF_MAP = 4,
+    /**
+     * @brief Number of events
+     *
+     */
+    EVENTS = 5
+};
+
+/**
+ * @brief Structure containing the counters of one thread, on its own cache lines
+ *
+ */
+typedef struct Counters
+{
+    /**
+     * @brief Ticks spent in each phase
+     *
+     */
+    uint64_t ticks[PHASES];
+    /**
+     * @brief Number of times each phase was timed
+     *
+     */
+    uint64_t calls[PHASES];
+    /**
+     * @brief Number of each event
+     *
+     */
+    uint64_t events[EVENTS];
+    /**
+     * @brief Counters of the next registered thread
+     *
+     */
+    struct Counters *next;
+} __attribute__((aligned(64))) Counters;
+
+/**
+ * @brief Counters of the current thread, NULL until its first event
+ *
+ */
+extern __thread Counters *thread_counters;
+
+/**
+ * @brief Read the tick counter, CPU cycles on x86 and nanoseconds elsewhere
+ *
+ * @return uint64_t Ticks
+ */
+static inline uint64_t read_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Allocate and register the counters of the current thread
+ *
+ * @return Counters* Counters of the current thread
+ */
+Counters *register_counters();
+
+/**
+ * @brief Get the counters of the current thread
+ *
+ * @return Counters* Counters of the current thread
+ */
+static inline Counters *get_counters()
+{
+    return thread_counters != NULL ? thread_counters : register_counters();
+}
+
+/**
+ * @brief Add to a counter of the current thread, readable by the reporter thread
+ *
+ * @param counter Counter
+ * @param value Value to add
+ */
+static inline void add_counter(uint64_t *counter, uint64_t value)
+{
+    // only the owning thread writes, so a relaxed load and store is enough
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+#ifdef INSTRUMENT
+/**
+ * @brief Start timing a phase
+ *
+ */
+#define INSTRUMENT_START(timer) uint64_t timer = read_ticks()
+/**
+ * @brief Stop timing a phase
+ *
+ */
+#define INSTRUMENT_STOP(timer, phase)                                         \
+    do                                                                        \
+    {                                                                         \
+        Counters *counters_ = get_counters();                                 \
+        add_counter(&counters_->ticks[phase], read_ticks() - (timer));        \
+        add_counter(&counters_->calls[phase], 1);                             \
+    } while (0)
+/**
+ * @brief Count an event, the count is not evaluated when compiled out
+ *
+ */
+#define INSTRUMENT_COUNT(event, count) add_counter(&get_counters()->events[event], (count))
+#else
+#define INSTRUMENT_START(timer)
+#define INSTRUMENT_STOP(timer, phase)
+#define INSTRUMENT_COUNT(event, count)
+#endif
+
+/**
+ * @brief Start the instrumentation
+ *
+ * @param seconds Interval of the JSON lines printed by a reporter thread, 0 for none
+ * @return int 1 if success, 0 otherwise
+ */
+int start_instrument(int seconds);
+
+/**
+ * @brief Stop the reporter thread and print the summary
+ *
+ */
+void stop_instrument();
+
+#endif
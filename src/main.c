@@ -9,11 +9,17 @@
  */
 
 #include <stdio.h>
-#include <sys/time.h>
 #include <signal.h>
 #include "q_learning.h"
 #include "gui.h"
 #include "params.h"
+#include "train.h"
+#include "instrument.h"
+#include "convergence.h"
+#include "solver.h"
+#include "goals.h"
+#include "policy.h"
+#include "evaluate.h"
 
 /**
  * @brief Running state of the program
@@ -28,22 +34,93 @@ int running = 1;
  */
 void ctrl_c_handler(int signum)
 {
-    running = 0;
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
 }
 
 /**
- * @brief Free memory and destroy GUI
+ * @brief Stop the background checkpoints, free memory and destroy GUI
  *
  * @param map Map to free
  * @param params Params
+ * @param checkpoint Background checkpoints to stop before the map is freed, NULL if not started
  */
-void quit(Map map, Params params)
+void quit(Map map, Params params, Checkpoint *checkpoint)
 {
+    if (checkpoint != NULL)
+    {
+        stop_checkpoint(checkpoint, map);
+    }
     if (params.gui)
     {
         destroy_gui();
     }
     free_map(map);
+    free(params.waypoints);
+    free(params.goals);
+}
+
+/**
+ * @brief Show the snapshots published by the trainer at a fixed frame rate and send it the key presses, until it stops
+ *
+ * @param display Display shared with the trainer
+ * @param params Parameters
+ */
+void run_gui(Display *display, Params params)
+{
+    SDL_Event event;
+    while (!__atomic_load_n(&display->done, __ATOMIC_ACQUIRE))
+    {
+        Uint32 frame = SDL_GetTicks();
+
+        // handle SDL events
+        INSTRUMENT_START(poll_start);
+        while (SDL_PollEvent(&event))
+        {
+            // window close button
+            if (event.type == SDL_QUIT)
+            {
+                send_control(display, CONTROL_QUIT);
+            }
+            // key pressed
+            else if (event.type == SDL_KEYDOWN)
+            {
+                switch (event.key.keysym.sym)
+                {
+                // q or escape to quit
+                case SDLK_q:
+                case SDLK_ESCAPE:
+                    send_control(display, CONTROL_QUIT);
+                    break;
+                // space to toggle slow mode
+                case SDLK_SPACE:
+                    send_control(display, CONTROL_SLOW);
+                    break;
+                case SDLK_p:
+                    send_control(display, CONTROL_PAUSE);
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+        INSTRUMENT_STOP(poll_start, POLL);
+
+        // show GUI
+        INSTRUMENT_START(render_start);
+        Map *snapshot = read_display(display);
+        show_map(*snapshot);
+        if (params.debug)
+        {
+            show_q(*snapshot);
+        }
+        INSTRUMENT_STOP(render_start, RENDER);
+
+        Uint32 elapsed = SDL_GetTicks() - frame;
+        if (elapsed < 1000 / DISPLAY_FPS)
+        {
+            SDL_Delay(1000 / DISPLAY_FPS - elapsed);
+        }
+    }
 }
 
 /**
@@ -63,10 +140,61 @@ int main(int argc, char **argv)
     print_params(params);
 
     // init and build map
-    Map map = build_map(params.teleporter);
+    Map map;
+    // background checkpoints, stopped by quit() once started
+    Checkpoint checkpoint;
+    Checkpoint *checkpointing = NULL;
+    if (params.map != NULL)
+    {
+        if (load_map(&map, params.map, params.teleporter, params.sparse))
+        {
+            printf("Loaded map from %s\n\n", params.map);
+        }
+        else
+        {
+            printf("Failed to load map from %s\n", params.map);
+            return 1;
+        }
+    }
+    else if (!build_map(&map, params.teleporter, params.sparse))
+    {
+        printf("Failed to build map\n");
+        return 1;
+    }
+
+    // seed the random generator of the agent
+    seed_random(&map.random, params.seed);
+
+    // precompute transitions
+    if (params.transitions && !build_transitions(&map, params))
+    {
+        printf("Failed to build transition table\n");
+        quit(map, params, checkpointing);
+        return 1;
+    }
+
+    // model of the observed transitions for planning
+    if (params.dyna > 0 && !init_model(&map, params.prioritized))
+    {
+        printf("Failed to allocate Dyna-Q model\n");
+        quit(map, params, checkpointing);
+        return 1;
+    }
+
+    // buffer of the transitions for experience replay
+    if (params.replay > 0 && !init_replay(&map.replay, params.replay, params.replay_batch, params.sampling == PRIORITIZED))
+    {
+        printf("Failed to allocate replay buffer\n");
+        quit(map, params, checkpointing);
+        return 1;
+    }
 
-    // load Q-table
-    if (params.load != NULL)
+    // load Q-table, from the last checkpoint when resuming
+    if (params.resume && load_q(&map, params.checkpoint))
+    {
+        printf("Resumed from checkpoint %s at epoch %d\n\n", params.checkpoint, map.epoch);
+    }
+    else if (params.load != NULL)
     {
         if (load_q(&map, params.load))
         {
@@ -75,24 +203,53 @@ int main(int argc, char **argv)
         else
         {
             printf("Failed to load Q-table from %s\n", params.load);
-            quit(map, params);
+            quit(map, params, checkpointing);
             return 1;
         }
     }
 
+    // test mode follows the greedy policy of the Q-table compiled once, or the one of a policy file, outside loop mode
+    // maps too large to index their cells by int keep following the Q-table
+    Policy policy = {0};
+    if (params.policy != NULL)
+    {
+        if (load_policy(&policy, map, params.policy))
+        {
+            printf("Loaded policy from %s\n\n", params.policy);
+        }
+        else
+        {
+            printf("Failed to load policy from %s\n", params.policy);
+            quit(map, params, checkpointing);
+            return 1;
+        }
+    }
+    else if (params.test && !params.loop && check_cells(map) && !compile_policy(&policy, map))
+    {
+        printf("Failed to compile policy\n");
+        quit(map, params, checkpointing);
+        return 1;
+    }
+
     // find goals
-    State goal_1 = find_state(map, GOAL_1);
-    if (!check_state(map, goal_1))
+    if (map.landmarks.goals_count == 0)
+    {
+        printf("No goal exists\n");
+        quit(map, params, checkpointing);
+        return 1;
+    }
+    // loop mode needs both goals as checkpoints, unless given its waypoints
+    int default_route = params.loop && params.waypoints_count == 0;
+    if (default_route && !check_state(map, find_state(map, GOAL_1)))
     {
         printf("Goal %d does not exist\n", GOAL_1);
-        quit(map, params);
+        quit(map, params, checkpointing);
         return 1;
     }
-    State goal_2 = find_state(map, GOAL_2);
-    if (!check_state(map, goal_2))
+    if (default_route && !check_state(map, find_state(map, GOAL_2)))
     {
         printf("Goal %d does not exist\n", GOAL_2);
-        quit(map, params);
+        quit(map, params, checkpointing);
         return 1;
     }
 
@@ -102,176 +259,172 @@ int main(int argc, char **argv)
         if (!init_gui_map(map))
         {
             printf("Failed to initialize map window\n");
-            quit(map, params);
+            quit(map, params, checkpointing);
             return 1;
         }
         if (params.debug && !init_gui_q(map))
         {
             printf("Failed to initialize q window\n");
-            quit(map, params);
+            quit(map, params, checkpointing);
             return 1;
         }
     }
 
-    enum Action action;
-    SDL_Event event;
-    int slow = 1;
-    int pause = 0;
-    int checkpoint_count = -1;
-    int time = 0;
-    struct timeval start, end;
-    if (!params.test)
+    Convergence convergence;
+    init_convergence(&convergence);
+
+    if (!start_instrument(params.stats))
     {
-        gettimeofday(&start, NULL);
+        printf("Failed to start instrumentation\n");
+        quit(map, params, checkpointing);
+        return 1;
     }
 
-    // main loop
-    while (running && ((params.epochs >= 0 && map.epoch < params.epochs) || params.epochs < 0))
+    // start background checkpoints
+    if (params.checkpoint_every > 0 && !params.test)
     {
-        if (!pause)
+        if (!start_checkpoint(&checkpoint, map, params))
         {
-            // check if checkpoint reached
-            if (params.loop && (checkpoint_count == -1 || (checkpoint_count == 0 && are_states_equal(map.agent, goal_1)) || (checkpoint_count == 1 && are_states_equal(map.agent, goal_2)) || (checkpoint_count == 2 && are_states_equal(map.agent, map.start))))
-            {
-                checkpoint_count++;
-                char *checkpoint_path = NULL;
-                switch (checkpoint_count)
-                {
-                case 0:
-                    checkpoint_path = strdup("./loop/goal_1.txt");
-                    break;
-                case 1:
-                    checkpoint_path = strdup("./loop/goal_2.txt");
-                    break;
-                case 2:
-                    checkpoint_path = strdup("./loop/start.txt");
-                    break;
-                default:
-                    break;
-                }
-                if (checkpoint_path != NULL)
-                {
-                    if (!load_q(&map, checkpoint_path))
-                    {
-                        printf("Failed to load Q-table from %s\n", checkpoint_path);
-                        free(checkpoint_path);
-                        quit(map, params);
-                        return 1;
-                    }
-                    free(checkpoint_path);
-                }
-            }
-
-            // show GUI
-            if (params.gui)
-            {
-                show_map(map);
-                if (params.debug)
-                {
-                    show_q(map);
-                }
-                // slow mode
-                if (slow)
-                {
-                    SDL_Delay(100);
-                }
-            }
-
-            // get next state
-            State next_state = q(&map, map.agent, params);
-            if (get_type(map, next_state) != WALL)
-            {
-                map.agent = next_state;
-            }
-            map.steps++;
+            printf("Failed to start checkpoints to %s\n", params.checkpoint);
+            quit(map, params, checkpointing);
+            return 1;
+        }
+        checkpointing = &checkpoint;
+    }
 
-            // check if goal reached
-            if ((!params.loop && (are_states_equal(map.agent, goal_1) || are_states_equal(map.agent, goal_2))) || (params.loop && checkpoint_count == 3))
-            {
-                // epoch duration
-                if (!params.test)
-                {
-                    gettimeofday(&end, NULL);
-                    time = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
-                }
+    // batched and parallel training run until the epoch limit or Ctrl+C, so the main loop is skipped afterwards
+    if (params.agents > 1 && !train_batch(&map, params, &running, checkpointing, &convergence))
+    {
+        printf("Failed to start batch training\n");
+        quit(map, params, checkpointing);
+        return 1;
+    }
+    if (params.solver == VALUE_ITERATION && !solve_q(&map, params))
+    {
+        printf("Failed to run value iteration\n");
+        quit(map, params, checkpointing);
+        return 1;
+    }
+    if (params.solver == Q_LEARNING && params.threads > 1 && !train_parallel(&map, params, &running, checkpointing, &convergence))
+    {
+        printf("Failed to start training threads\n");
+        quit(map, params, checkpointing);
+        return 1;
+    }
 
-                // show GUI
-                if (params.gui)
-                {
-                    show_map(map);
-                    if (params.debug)
-                    {
-                        show_q(map);
-                    }
-                    if (slow)
-                    {
-                        SDL_Delay(100);
-                    }
-                }
+    // goal-conditioned training replaces the single-agent training, with one Q-table per goal
+    Goals goals = {0};
+    if (params.goals_count > 0)
+    {
+        if (!init_goals(&goals, map, params))
+        {
+            quit(map, params, checkpointing);
+            return 1;
+        }
+        train_goals(&map, &goals, params, &running, &convergence);
+    }
 
-                // reset agent
-                map.agent = map.start;
-                if (!params.test)
-                {
-                    map.epoch++;
-                }
-                if (params.loop)
-                {
-                    checkpoint_count = -1;
-                }
+    // evaluation of the greedy policy from every starting cell, during the training and at the end
+    Evaluator evaluator = {0};
+    if ((params.eval || params.eval_every > 0) && !init_evaluator(&evaluator, map, params))
+    {
+        printf("Failed to build evaluator\n");
+        quit(map, params, checkpointing);
+        return 1;
+    }
 
-                // print epoch info
-                if (params.print)
-                {
-                    if (params.test)
-                    {
-                        printf("%d steps\n", map.steps);
-                    }
-                    else
-                    {
-                        printf("Epoch %d/%d\t%d steps\t%d ms\n", map.epoch, params.epochs, map.steps, time);
-                    }
-                }
-                map.steps = 0;
+    // loop mode switches between the Q-tables of its waypoints, all loaded beforehand
+    Route route;
+    if (params.loop && !init_route(&route, &map, params))
+    {
+        quit(map, params, checkpointing);
+        return 1;
+    }
 
-                if (!params.test)
-                {
-                    gettimeofday(&start, NULL);
-                }
-            }
+    // single-agent training, on its own thread while the GUI is shown at a fixed frame rate
+    Trainer trainer = {&map, params, &running, checkpointing, &convergence, NULL, params.loop ? &route : NULL, policy.data != NULL ? &policy : NULL, params.eval_every > 0 ? &evaluator : NULL, 1};
+    if (params.solver == Q_LEARNING && params.threads == 1 && params.agents == 1 && params.goals_count == 0)
+    {
+        Display display;
+        pthread_t thread;
+        if (!params.gui)
+        {
+            run_trainer(&trainer);
         }
-
-        // handle SDL events
-        while (SDL_PollEvent(&event))
+        else if (!init_display(&display, map, params.debug))
         {
-            // window close button
-            if (event.type == SDL_QUIT)
+            printf("Failed to allocate GUI snapshots\n");
+            trainer.status = 0;
+        }
+        else
+        {
+            trainer.display = &display;
+            if (pthread_create(&thread, NULL, run_trainer, &trainer) != 0)
             {
-                running = 0;
+                printf("Failed to start training thread\n");
+                trainer.status = 0;
             }
-            // key pressed
-            else if (event.type == SDL_KEYDOWN)
+            else
             {
-                switch (event.key.keysym.sym)
-                {
-                // q or escape to quit
-                case SDLK_q:
-                case SDLK_ESCAPE:
-                    running = 0;
-                    break;
-                // space to toggle slow mode
-                case SDLK_SPACE:
-                    slow = !slow;
-                    break;
-                case SDLK_p:
-                    pause = !pause;
-                    break;
-                default:
-                    break;
-                }
+                run_gui(&display, params);
+                pthread_join(thread, NULL);
             }
+            free_display(&display);
         }
     }
+    if (params.loop)
+    {
+        free_route(&route, &map);
+    }
+    if (!trainer.status)
+    {
+        quit(map, params, checkpointing);
+        return 1;
+    }
+
+    stop_instrument();
+
+    if (convergence.epoch >= 0)
+    {
+        printf("\nConverged at epoch %d, stopped after %d epochs\n", convergence.epoch, map.epoch);
+    }
+
+    // memory of the sparse map and Q-table against the dense buffers they replace
+    if (map.sparse != NULL && params.print)
+    {
+        long long cells = (long long)map.width * map.height;
+        printf("\nSparse Q-table: %zu of %lld cells visited (%.2f%%), %zu bytes instead of %zu bytes\n", map.sparse->count, cells,
+               100.0 * map.sparse->count / cells, sparse_memory(map.sparse), (size_t)cells * ACTIONS * sizeof(QValue));
+    }
+    if (map.sparse_map != NULL && params.print)
+    {
+        long long cells = (long long)map.width * map.height;
+        printf("Sparse map: %zu of %lld cells not empty, %zu bytes instead of %zu bytes\n", map.sparse_map->count, cells,
+               sparse_map_memory(map.sparse_map), (size_t)cells * (sizeof(int) + 1));
+    }
+
+    // evaluate the policy followed in test mode, or the one of the trained Q-table
+    if (params.eval)
+    {
+        Evaluation evaluation;
+        if (policy.data != NULL ? evaluate_policy(&evaluator, map, &policy, &evaluation) : evaluate_q(&evaluator, map, &evaluation))
+        {
+            printf("\n");
+            print_evaluation(evaluation, map.epoch);
+        }
+        else
+        {
+            printf("\nFailed to evaluate the greedy policy\n");
+        }
+    }
+    free_evaluator(&evaluator);
+
+    // write the last checkpoint
+    if (checkpointing != NULL)
+    {
+        stop_checkpoint(checkpointing, map);
+        checkpointing = NULL;
+    }
 
     // save Q-table
     if (params.save != NULL)
@@ -286,7 +439,35 @@ int main(int argc, char **argv)
         }
     }
 
+    // export the policy followed in test mode, or the one of the trained Q-table
+    if (params.export_policy != NULL)
+    {
+        if ((policy.data != NULL || compile_policy(&policy, map)) && save_policy(policy, params.export_policy))
+        {
+            printf("\nExported policy to %s, %zu bytes with %d tied cells\n", params.export_policy, sizeof(PolicyHeader) + policy.size, policy.ties_count);
+        }
+        else
+        {
+            printf("\nFailed to export policy to %s\n", params.export_policy);
+        }
+    }
+    free_policy(&policy);
+
+    // save the Q-table of each goal
+    for (int i = 0; i < goals.count; i++)
+    {
+        if (save_goal(map, goals, i, params.goals[i].file))
+        {
+            printf("\nSaved Q-table of goal %d to %s\n", i + 1, params.goals[i].file);
+        }
+        else
+        {
+            printf("\nFailed to save Q-table of goal %d to %s\n", i + 1, params.goals[i].file);
+        }
+    }
+    free_goals(goals);
+
     // free memory and destroy GUI
-    quit(map, params);
+    quit(map, params, checkpointing);
     return 0;
 }
\ No newline at end of file
@@ -17,12 +17,42 @@ Params parse_params(int argc, char **argv)
     params.epsilon = EPSILON;
     params.alpha = ALPHA;
     params.gamma = GAMMA;
+    params.tolerance = 0;
+    params.patience = PATIENCE;
+    params.seed = time(NULL);
     params.euclidean = 0;
     params.teleporter = 0;
     params.loop = 0;
+    params.waypoints = NULL;
+    params.waypoints_count = 0;
+    params.goals = NULL;
+    params.goals_count = 0;
+    params.transitions = 0;
+    params.sparse = 0;
+    params.dyna = 0;
+    params.prioritized = 0;
+    params.theta = THETA;
+    params.replay = 0;
+    params.replay_batch = REPLAY_BATCH;
+    params.sampling = UNIFORM;
+    params.solver = Q_LEARNING;
+    params.gauss_seidel = 0;
+    params.threads = 1;
+    params.agents = 1;
     params.test = 0;
+    params.map = NULL;
     params.load = NULL;
     params.save = NULL;
+    params.policy = NULL;
+    params.export_policy = NULL;
+    params.eval = 0;
+    params.eval_every = 0;
+    params.eval_starts = 0;
+    params.checkpoint = "checkpoint.bin";
+    params.checkpoint_every = 0;
+    params.checkpoint_seconds = 0;
+    params.resume = 0;
+    params.stats = 0;
     params.gui = 1;
     params.debug = 0;
     params.print = 1;
@@ -45,6 +75,18 @@ Params parse_params(int argc, char **argv)
         {
             params.gamma = atof(argv[++i]);
         }
+        else if (strcmp(argv[i], "-tolerance") == 0)
+        {
+            params.tolerance = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-patience") == 0)
+        {
+            params.patience = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-seed") == 0)
+        {
+            params.seed = atol(argv[++i]);
+        }
         else if (strcmp(argv[i], "-euclidean") == 0)
         {
             params.euclidean = 1;
@@ -57,10 +99,119 @@ Params parse_params(int argc, char **argv)
         {
             params.loop = 1;
         }
+        else if (strcmp(argv[i], "-waypoint") == 0)
+        {
+            Waypoint *waypoints = realloc(params.waypoints, (params.waypoints_count + 1) * sizeof(Waypoint));
+            if (waypoints == NULL)
+            {
+                printf("Failed to allocate waypoints\n");
+                exit(1);
+            }
+            params.waypoints = waypoints;
+            params.waypoints[params.waypoints_count].x = atoi(argv[++i]);
+            params.waypoints[params.waypoints_count].y = atoi(argv[++i]);
+            params.waypoints[params.waypoints_count].file = argv[++i];
+            params.waypoints_count++;
+            params.loop = 1;
+        }
+        else if (strcmp(argv[i], "-goal") == 0)
+        {
+            Waypoint *goals = realloc(params.goals, (params.goals_count + 1) * sizeof(Waypoint));
+            if (goals == NULL)
+            {
+                printf("Failed to allocate goals\n");
+                exit(1);
+            }
+            params.goals = goals;
+            params.goals[params.goals_count].x = atoi(argv[++i]);
+            params.goals[params.goals_count].y = atoi(argv[++i]);
+            params.goals[params.goals_count].file = argv[++i];
+            params.goals_count++;
+        }
+        else if (strcmp(argv[i], "-transitions") == 0)
+        {
+            params.transitions = 1;
+        }
+        else if (strcmp(argv[i], "-sparse") == 0)
+        {
+            params.sparse = 1;
+        }
+        else if (strcmp(argv[i], "-dyna") == 0)
+        {
+            params.dyna = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-prioritized") == 0)
+        {
+            params.prioritized = 1;
+        }
+        else if (strcmp(argv[i], "-theta") == 0)
+        {
+            params.theta = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-replay") == 0)
+        {
+            params.replay = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-batch") == 0)
+        {
+            params.replay_batch = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-sampling") == 0)
+        {
+            char *sampling = argv[++i];
+            if (strcmp(sampling, "uniform") == 0)
+            {
+                params.sampling = UNIFORM;
+            }
+            else if (strcmp(sampling, "prioritized") == 0)
+            {
+                params.sampling = PRIORITIZED;
+            }
+            else
+            {
+                printf("Unknown sampling: %s\n", sampling);
+                print_help();
+                exit(0);
+            }
+        }
+        else if (strcmp(argv[i], "-solver") == 0)
+        {
+            char *solver = argv[++i];
+            if (strcmp(solver, "q-learning") == 0)
+            {
+                params.solver = Q_LEARNING;
+            }
+            else if (strcmp(solver, "value-iteration") == 0)
+            {
+                params.solver = VALUE_ITERATION;
+            }
+            else
+            {
+                printf("Unknown solver: %s\n", solver);
+                print_help();
+                exit(0);
+            }
+        }
+        else if (strcmp(argv[i], "-gauss-seidel") == 0)
+        {
+            params.gauss_seidel = 1;
+        }
+        else if (strcmp(argv[i], "-threads") == 0)
+        {
+            params.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-agents") == 0)
+        {
+            params.agents = atoi(argv[++i]);
+        }
         else if (strcmp(argv[i], "-test") == 0)
         {
             params.test = 1;
         }
+        else if (strcmp(argv[i], "-map") == 0)
+        {
+            params.map = argv[++i];
+        }
         else if (strcmp(argv[i], "-load") == 0)
         {
             params.load = argv[++i];
@@ -69,6 +220,45 @@ Params parse_params(int argc, char **argv)
         {
             params.save = argv[++i];
         }
+        else if (strcmp(argv[i], "-policy") == 0)
+        {
+            params.policy = argv[++i];
+            params.test = 1;
+        }
+        else if (strcmp(argv[i], "-export-policy") == 0)
+        {
+            params.export_policy = argv[++i];
+        }
+        else if (strcmp(argv[i], "-eval") == 0)
+        {
+            params.eval = 1;
+        }
+        else if (strcmp(argv[i], "-eval-every") == 0)
+        {
+            params.eval_every = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-eval-starts") == 0)
+        {
+            params.eval_starts = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-checkpoint") == 0)
+        {
+            params.checkpoint = argv[++i];
+        }
+        else if (strcmp(argv[i], "-checkpoint-every") == 0)
+        {
+            char *every = argv[++i];
+            params.checkpoint_every = atoi(every);
+            params.checkpoint_seconds = every[strlen(every) - 1] == 's';
+        }
+        else if (strcmp(argv[i], "-resume") == 0)
+        {
+            params.resume = 1;
+        }
+        else if (strcmp(argv[i], "-stats") == 0)
+        {
+            params.stats = atoi(argv[++i]);
+        }
         else if (strcmp(argv[i], "-nogui") == 0)
         {
             params.gui = 0;
@@ -94,6 +284,29 @@ Params parse_params(int argc, char **argv)
         }
     }
 
+    // special case for goal-conditioned training, a single agent without GUI filling the Q-tables it saves itself
+    if (params.goals_count > 0)
+    {
+        params.loop = 0;
+        params.test = 0;
+        params.euclidean = 0;
+        params.solver = Q_LEARNING;
+        params.sparse = 0;
+        params.dyna = 0;
+        params.replay = 0;
+        params.threads = 1;
+        params.agents = 1;
+        params.gui = 0;
+        params.load = NULL;
+        params.save = NULL;
+        params.policy = NULL;
+        params.export_policy = NULL;
+        params.eval = 0;
+        params.eval_every = 0;
+        params.checkpoint_every = 0;
+        params.resume = 0;
+    }
+
     // special case for loop
     if (params.loop) {
         params.epochs = -1;
@@ -102,6 +315,87 @@ Params parse_params(int argc, char **argv)
         params.test = 1;
         params.load = NULL;
         params.save = NULL;
+        params.policy = NULL;
+        params.export_policy = NULL;
+        params.eval = 0;
+        params.eval_every = 0;
+    }
+
+    // special case for the evaluations, periodic ones only run between the epochs of the single-agent training
+    if (params.eval_every < 0)
+    {
+        params.eval_every = 0;
+    }
+    if (params.eval_starts < 0)
+    {
+        params.eval_starts = 0;
+    }
+
+    // special case for early stopping, at least one converged epoch is needed
+    if (params.patience < 1)
+    {
+        params.patience = 1;
+    }
+
+    // special case for value iteration, which replaces the training and runs without GUI
+    if (params.test)
+    {
+        params.solver = Q_LEARNING;
+    }
+    if (params.solver == VALUE_ITERATION)
+    {
+        params.agents = 1;
+        params.gui = 0;
+    }
+
+    // special case for experience replay, which replaces the update of each step and so the Dyna-Q planning after it
+    if (params.replay < 0 || params.test)
+    {
+        params.replay = 0;
+    }
+    if (params.replay_batch < 1)
+    {
+        params.replay_batch = 1;
+    }
+    if (params.replay > 0)
+    {
+        params.dyna = 0;
+    }
+
+    // special case for Dyna-Q and experience replay, their model or buffer is not shared between threads or agents
+    if (params.dyna < 0 || params.test)
+    {
+        params.dyna = 0;
+    }
+    if (params.dyna > 0 || params.replay > 0)
+    {
+        params.threads = 1;
+        params.agents = 1;
+    }
+
+    // special case for the sparse Q-table, its hash table grows without locks and is not swept by value iteration
+    if (params.solver == VALUE_ITERATION)
+    {
+        params.sparse = 0;
+    }
+    if (params.sparse)
+    {
+        params.threads = 1;
+        params.agents = 1;
+    }
+
+    // special case for several threads or agents, only available for training without GUI
+    if (params.agents < 1 || params.test)
+    {
+        params.agents = 1;
+    }
+    if (params.threads < 1 || params.test || params.agents > 1)
+    {
+        params.threads = 1;
+    }
+    if (params.threads > 1 || params.agents > 1)
+    {
+        params.gui = 0;
     }
 
     return params;
@@ -115,12 +409,39 @@ void print_help()
     printf("-epsilon <float> (default: %f) : Exploration rate\n", EPSILON);
     printf("-alpha <float> (default: %f) : Learning rate\n", ALPHA);
     printf("-gamma <float> (default: %f) : Discount factor\n", GAMMA);
+    printf("-tolerance <float> (default: 0) : Stop the training once no Q-value changes by more than this and no greedy action changes for patience epochs, 0 to disable\n");
+    printf("-patience <int> (default: %d) : Number of consecutive converged epochs before stopping\n", PATIENCE);
+    printf("-seed <int> (default: time) : Seed of the random generator, for reproducible runs\n");
     printf("-euclidean : Use euclidean distance instead of default reinforcement system\n");
     printf("-teleporter : Enable teleporter in the environment\n");
     printf("-loop : Make the agent go through goal 1, goal 2 and starting point\n");
+    printf("-waypoint <x> <y> <filename> : Add a waypoint to the loop, reached with the Q-table of the file, instead of goal 1, goal 2 and starting point\n");
+    printf("-goal <x> <y> <filename> : Add a goal trained together with the others in a single run, its Q-table saved to the file\n");
+    printf("-transitions : Precompute the transitions of the map for faster steps\n");
+    printf("-sparse : Store only the Q-values of the visited cells and the cells of the map that are not empty, for large maps mostly unvisited\n");
+    printf("-dyna <int> (default: 0) : Number of Dyna-Q planning updates replaying observed transitions after each step, 0 to disable\n");
+    printf("-prioritized : Replay the transitions with the largest TD error first during Dyna-Q planning\n");
+    printf("-theta <float> (default: %g) : Smallest TD error of a transition replayed by prioritized planning\n", THETA);
+    printf("-replay <int> (default: 0) : Number of transitions of the experience replay buffer, 0 to update the Q-table at each step\n");
+    printf("-batch <int> (default: %d) : Number of transitions of a replay minibatch, learned every as many steps\n", REPLAY_BATCH);
+    printf("-sampling <name> (default: uniform) : uniform, or prioritized to replay the transitions proportionally to their TD error\n");
+    printf("-solver <name> (default: q-learning) : q-learning, or value-iteration to compute the Q-table directly from the map, with -epochs as maximum number of sweeps\n");
+    printf("-gauss-seidel : Update the Q-table in place during value iteration sweeps\n");
+    printf("-threads <int> (default: 1) : Number of training threads sharing the Q-table, without GUI\n");
+    printf("-agents <int> (default: 1) : Number of agents trained together on a single thread, without GUI\n");
     printf("-test : Enable test mode instead of train mode\n");
+    printf("-map <filename> (default: NULL) : Load the map from file instead of the default map\n");
     printf("-load <filename> (default: NULL) : Load a saved Q-table from file\n");
-    printf("-save <filename> (default: NULL) : Save the Q-table to a file\n");
+    printf("-save <filename> (default: NULL) : Save the Q-table to a file, in binary format if it ends with .bin\n");
+    printf("-policy <filename> (default: NULL) : Test with the compiled policy of the file instead of a Q-table, enables test mode\n");
+    printf("-export-policy <filename> (default: NULL) : Export the compiled greedy policy of the Q-table to a file\n");
+    printf("-eval : Evaluate the greedy policy from every starting cell at the end, with the success rate, the steps and their excess over the shortest paths\n");
+    printf("-eval-every <int> (default: 0) : Evaluate the greedy policy every n epochs of single-agent training, 0 to disable\n");
+    printf("-eval-starts <int> (default: 0) : Number of starting cells sampled for the evaluations, 0 for all of them\n");
+    printf("-checkpoint <filename> (default: checkpoint.bin) : Checkpoint file, in binary format if it ends with .bin\n");
+    printf("-checkpoint-every <int>[s] (default: 0) : Save a checkpoint every n epochs, or every n seconds with the s suffix, in the background\n");
+    printf("-resume : Resume the training from the checkpoint file if it exists\n");
+    printf("-stats <int> (default: 0) : Print the instrumentation counters as a JSON line every n seconds, needs make INSTRUMENT=1\n");
     printf("-nogui : Disable the graphical user interface\n");
     printf("-debug : Enable debug mode with the Q-table shown on the screen\n");
     printf("-noprint : Disable printing information on the console\n");
@@ -134,12 +455,45 @@ void print_params(Params params)
     printf("epsilon: %f\n", params.epsilon);
     printf("alpha: %f\n", params.alpha);
     printf("gamma: %f\n", params.gamma);
+    printf("tolerance: %g\n", params.tolerance);
+    printf("patience: %d\n", params.patience);
+    printf("seed: %ld\n", params.seed);
     printf("euclidean: %d\n", params.euclidean);
     printf("teleporter: %d\n", params.teleporter);
     printf("loop: %d\n", params.loop);
+    for (int i = 0; i < params.waypoints_count; i++)
+    {
+        printf("waypoint %d: (%d, %d) %s\n", i + 1, params.waypoints[i].x, params.waypoints[i].y, params.waypoints[i].file);
+    }
+    for (int i = 0; i < params.goals_count; i++)
+    {
+        printf("goal %d: (%d, %d) %s\n", i + 1, params.goals[i].x, params.goals[i].y, params.goals[i].file);
+    }
+    printf("transitions: %d\n", params.transitions);
+    printf("sparse: %d\n", params.sparse);
+    printf("dyna: %d\n", params.dyna);
+    printf("prioritized: %d\n", params.prioritized);
+    printf("theta: %g\n", params.theta);
+    printf("replay: %d\n", params.replay);
+    printf("batch: %d\n", params.replay_batch);
+    printf("sampling: %s\n", params.sampling == PRIORITIZED ? "prioritized" : "uniform");
+    printf("solver: %s\n", params.solver == VALUE_ITERATION ? "value-iteration" : "q-learning");
+    printf("gauss seidel: %d\n", params.gauss_seidel);
+    printf("threads: %d\n", params.threads);
+    printf("agents: %d\n", params.agents);
     printf("test: %d\n", params.test);
+    printf("map: %s\n", params.map);
     printf("load: %s\n", params.load);
     printf("save: %s\n", params.save);
+    printf("policy: %s\n", params.policy);
+    printf("export policy: %s\n", params.export_policy);
+    printf("eval: %d\n", params.eval);
+    printf("eval every: %d\n", params.eval_every);
+    printf("eval starts: %d\n", params.eval_starts);
+    printf("checkpoint: %s\n", params.checkpoint);
+    printf("checkpoint every: %d%s\n", params.checkpoint_every, params.checkpoint_seconds ? "s" : "");
+    printf("resume: %d\n", params.resume);
+    printf("stats: %d\n", params.stats);
     printf("gui: %d\n", params.gui);
     printf("debug: %d\n", params.debug);
     printf("print: %d\n\n", params.print);
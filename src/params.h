@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /**
  * @brief Default vaue for alpha
@@ -30,6 +31,80 @@
  *
  */
 #define EPSILON 0.01
+/**
+ * @brief Default value for the patience of the early stopping
+ *
+ */
+#define PATIENCE 100
+/**
+ * @brief Default value for the priority threshold of prioritized sweeping
+ *
+ */
+#define THETA 0.01
+/**
+ * @brief Default number of transitions of a replay minibatch
+ *
+ */
+#define REPLAY_BATCH 32
+
+/**
+ * @brief Ways of computing the Q-table
+ *
+ */
+enum Solver
+{
+    /**
+     * @brief Sampled episodes updating the Q-table
+     *
+     */
+    Q_LEARNING = 0,
+    /**
+     * @brief Sweeps over the known transitions of the map
+     *
+     */
+    VALUE_ITERATION = 1
+};
+
+/**
+ * @brief Ways of sampling the replay buffer
+ *
+ */
+enum Sampling
+{
+    /**
+     * @brief Every transition is equally likely
+     *
+     */
+    UNIFORM = 0,
+    /**
+     * @brief Transitions are drawn proportionally to their TD error
+     *
+     */
+    PRIORITIZED = 1
+};
+
+/**
+ * @brief Structure representing a cell given on the command line with a Q-table file, a waypoint of the loop mode or a goal
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief X coordinate
+     *
+     */
+    int x;
+    /**
+     * @brief Y coordinate
+     *
+     */
+    int y;
+    /**
+     * @brief Q-table leading to the cell
+     *
+     */
+    char *file;
+} Waypoint;
 
 /**
  * @brief Structure containing the parameters of the program
@@ -57,6 +132,21 @@ typedef struct
      *
      */
     float gamma;
+    /**
+     * @brief Largest change of a Q-value in an epoch for the epoch to count as converged, 0 to disable early stopping
+     *
+     */
+    double tolerance;
+    /**
+     * @brief Number of consecutive converged epochs before stopping the training
+     *
+     */
+    int patience;
+    /**
+     * @brief Seed of the random generator
+     *
+     */
+    long seed;
     /**
      * @brief Use euclidean distance instead of default reinforcement system
      *
@@ -68,15 +158,100 @@ typedef struct
      */
     int teleporter;
     /**
-     * @brief Make the agent go through goal 1, goal 2 and starting point
+     * @brief Make the agent go through goal 1, goal 2 and starting point, or through the waypoints
      * 
      */
     int loop;
+    /**
+     * @brief Waypoints of the loop mode in order, NULL for goal 1, goal 2 and starting point
+     *
+     */
+    Waypoint *waypoints;
+    /**
+     * @brief Number of waypoints
+     *
+     */
+    int waypoints_count;
+    /**
+     * @brief Goals trained together, one Q-table per goal saved to its file, NULL for the usual training
+     *
+     */
+    Waypoint *goals;
+    /**
+     * @brief Number of goals trained together
+     *
+     */
+    int goals_count;
+    /**
+     * @brief Precompute the transitions of the map
+     *
+     */
+    int transitions;
+    /**
+     * @brief Store only the Q-values of the visited cells, in a hash table
+     *
+     */
+    int sparse;
+    /**
+     * @brief Number of Dyna-Q planning updates after each real step, 0 to disable planning
+     *
+     */
+    int dyna;
+    /**
+     * @brief Replay the transitions with the largest TD error first instead of uniformly
+     *
+     */
+    int prioritized;
+    /**
+     * @brief Smallest TD error of a transition queued by prioritized sweeping
+     *
+     */
+    double theta;
+    /**
+     * @brief Number of transitions of the replay buffer, 0 to update the Q-table at each step
+     *
+     */
+    int replay;
+    /**
+     * @brief Number of transitions of a replay minibatch, learned every as many steps
+     *
+     */
+    int replay_batch;
+    /**
+     * @brief Way of sampling the replay buffer
+     *
+     */
+    enum Sampling sampling;
+    /**
+     * @brief Way of computing the Q-table
+     *
+     */
+    enum Solver solver;
+    /**
+     * @brief Update the Q-table in place during value iteration sweeps instead of from the previous sweep
+     *
+     */
+    int gauss_seidel;
+    /**
+     * @brief Number of training threads sharing the Q-table
+     *
+     */
+    int threads;
+    /**
+     * @brief Number of agents stepped together on a single thread
+     *
+     */
+    int agents;
     /**
      * @brief Enable the testing mode instead of the training mode
      *
      */
     int test;
+    /**
+     * @brief Path to the file to load the map from
+     *
+     */
+    char *map;
     /**
      * @brief Path to the file to load the Q-table from
      *
@@ -87,6 +262,56 @@ typedef struct
      *
      */
     char *save;
+    /**
+     * @brief Path to the file to load the compiled policy of the test mode from, instead of compiling the Q-table
+     *
+     */
+    char *policy;
+    /**
+     * @brief Path to the file to export the compiled policy of the Q-table to
+     *
+     */
+    char *export_policy;
+    /**
+     * @brief Evaluate the greedy policy from every starting cell at the end
+     *
+     */
+    int eval;
+    /**
+     * @brief Interval in epochs between two evaluations of the greedy policy during single-agent training, 0 to disable them
+     *
+     */
+    int eval_every;
+    /**
+     * @brief Number of starting cells sampled for the evaluations, 0 for all of them
+     *
+     */
+    int eval_starts;
+    /**
+     * @brief Path to the checkpoint file
+     *
+     */
+    char *checkpoint;
+    /**
+     * @brief Interval between two checkpoints, 0 to disable checkpoints
+     *
+     */
+    int checkpoint_every;
+    /**
+     * @brief Whether the checkpoint interval is in seconds instead of epochs
+     *
+     */
+    int checkpoint_seconds;
+    /**
+     * @brief Resume the training from the checkpoint file if it exists
+     *
+     */
+    int resume;
+    /**
+     * @brief Interval in seconds of the instrumentation JSON lines, 0 to disable them
+     *
+     */
+    int stats;
     /**
      * @brief Enable the GUI
      *
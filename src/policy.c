@@ -0,0 +1,181 @@
+/**
+ * @file policy.c
+ * @author Antoine Qiu
+ * @brief Implementation of the greedy policy compiled from a Q-table for the test mode
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "policy.h"
+
+/**
+ * @brief Round a size up to a multiple of 8 bytes, so that every array of the buffer is aligned and checksummed
+ *
+ * @param size Size in bytes
+ * @return size_t Padded size
+ */
+static inline size_t pad_size(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+/**
+ * @brief Allocate the zeroed buffer of a policy and point its arrays into it
+ *
+ * @param policy Policy to initialize
+ * @param width Width of the map
+ * @param height Height of the map
+ * @param ties Number of tied cells
+ * @return int 1 if success, 0 otherwise
+ */
+static int allocate_policy(Policy *policy, int width, int height, int ties)
+{
+    size_t cells = (size_t)width * height;
+    size_t actions = pad_size((cells + 3) / 4);
+    size_t tied = pad_size((cells + 7) / 8);
+    size_t tie_cells = pad_size(ties * sizeof(uint32_t));
+    *policy = (Policy){.width = width, .height = height, .ties_count = ties};
+    policy->size = actions + tied + tie_cells + pad_size(ties);
+    policy->data = calloc(1, policy->size);
+    if (policy->data == NULL)
+    {
+        return 0;
+    }
+    policy->actions = policy->data;
+    policy->tied = policy->actions + actions;
+    policy->tie_cells = (uint32_t *)(policy->tied + tied);
+    policy->tie_masks = (uint8_t *)policy->tie_cells + tie_cells;
+    return 1;
+}
+
+/**
+ * @brief Find the greedy actions of a cell among its possible ones, like choose_action()
+ *
+ * @param map Map containing the Q-table
+ * @param cell Index of the cell
+ * @return int Bitmask of the greedy actions
+ */
+static int greedy_actions(Map map, int cell)
+{
+    int actions = get_actions(map, cell);
+    int votes = 0;
+    double max = 0;
+    for (int i = 0; i < ACTIONS; i++)
+    {
+        if (!(actions & 1 << i))
+        {
+            continue;
+        }
+        double value = get_q(map, cell, i);
+        if (votes == 0 || value > max)
+        {
+            max = value;
+            votes = 1 << i;
+        }
+        else if (value == max)
+        {
+            votes |= 1 << i;
+        }
+    }
+    return votes;
+}
+
+int compile_policy(Policy *policy, Map map)
+{
+    // the cells of the policy are indexed by int
+    if (!check_cells(map))
+    {
+        return 0;
+    }
+
+    // the tied cells are counted first so that the buffer is allocated once
+    int cells = map.width * map.height;
+    int ties = 0;
+    for (int cell = 0; cell < cells; cell++)
+    {
+        ties += get_cell_type(map, cell) != WALL && __builtin_popcount(greedy_actions(map, cell)) > 1;
+    }
+    if (!allocate_policy(policy, map.width, map.height, ties))
+    {
+        return 0;
+    }
+
+    int tie = 0;
+    for (int cell = 0; cell < cells; cell++)
+    {
+        int votes = get_cell_type(map, cell) != WALL ? greedy_actions(map, cell) : 0;
+        if (__builtin_popcount(votes) > 1)
+        {
+            policy->tied[cell >> 3] |= 1 << (cell & 7);
+            policy->tie_cells[tie] = cell;
+            policy->tie_masks[tie] = votes;
+            tie++;
+        }
+        else if (votes != 0)
+        {
+            policy->actions[cell >> 2] |= __builtin_ctz(votes) << (cell & 3) * 2;
+        }
+    }
+    return 1;
+}
+
+void free_policy(Policy *policy)
+{
+    free(policy->data);
+    *policy = (Policy){0};
+}
+
+int load_policy(Policy *policy, Map map, char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    PolicyHeader header;
+    if (!check_cells(map) || fread(&header, sizeof(PolicyHeader), 1, file) != 1 || memcmp(header.magic, POLICY_MAGIC, 4) != 0 || header.version != POLICY_VERSION ||
+        header.width != (uint32_t)map.width || header.height != (uint32_t)map.height || header.ties > header.width * header.height)
+    {
+        fclose(file);
+        return 0;
+    }
+    if (!allocate_policy(policy, header.width, header.height, header.ties))
+    {
+        fclose(file);
+        return 0;
+    }
+
+    // the file must end with the buffer
+    int status = fread(policy->data, policy->size, 1, file) == 1 && fgetc(file) == EOF && header.checksum == checksum_q(policy->data, policy->size);
+    fclose(file);
+    if (!status)
+    {
+        free_policy(policy);
+    }
+    return status;
+}
+
+int save_policy(Policy policy, char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    PolicyHeader header = {POLICY_MAGIC, POLICY_VERSION, policy.width, policy.height, policy.ties_count, 0, checksum_q(policy.data, policy.size)};
+    int status = fwrite(&header, sizeof(PolicyHeader), 1, file) == 1 && fwrite(policy.data, policy.size, 1, file) == 1;
+    return fclose(file) == 0 && status;
+}
+
+State act_policy(Map *map, State state, Policy *policy, Params params)
+{
+    INSTRUMENT_START(select_start);
+    INSTRUMENT_COUNT(STEPS, 1);
+    int cell = get_cell(*map, state);
+    enum Action action = policy_action(policy, &map->random, cell);
+    INSTRUMENT_STOP(select_start, SELECT);
+    int reward;
+    return step_state(map, state, action, params, &reward);
+}
@@ -0,0 +1,207 @@
+/**
+ * @file policy.h
+ * @author Antoine Qiu
+ * @brief Definition of the greedy policy compiled from a Q-table for the test mode
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdio.h>
+#include "q_learning.h"
+#include "params.h"
+
+/**
+ * @brief Magic number at the start of policy files
+ *
+ */
+#define POLICY_MAGIC "QPOL"
+/**
+ * @brief Version of the policy file format
+ *
+ */
+#define POLICY_VERSION 1
+
+/**
+ * @brief Header of policy files, followed by the buffer of the policy
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Magic number, POLICY_MAGIC
+     *
+     */
+    char magic[4];
+    /**
+     * @brief Version of the format, POLICY_VERSION
+     *
+     */
+    uint32_t version;
+    /**
+     * @brief Width of the map
+     *
+     */
+    uint32_t width;
+    /**
+     * @brief Height of the map
+     *
+     */
+    uint32_t height;
+    /**
+     * @brief Number of cells with several greedy actions
+     *
+     */
+    uint32_t ties;
+    /**
+     * @brief Padding so that the checksum is aligned
+     *
+     */
+    uint32_t reserved;
+    /**
+     * @brief Checksum of the buffer, computed like checksum_q()
+     *
+     */
+    uint64_t checksum;
+} PolicyHeader;
+
+/**
+ * @brief Structure representing a greedy policy, the action of each cell packed on 2 bits and the tied cells listed apart
+ *
+ * All the arrays live in a single buffer, each padded to 8 bytes, which is also the content of the policy files.
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Width of the map
+     *
+     */
+    int width;
+    /**
+     * @brief Height of the map
+     *
+     */
+    int height;
+    /**
+     * @brief Number of cells with several greedy actions
+     *
+     */
+    int ties_count;
+    /**
+     * @brief Greedy action of each cell on 2 bits, 4 cells per byte starting from the lowest bits
+     *
+     */
+    uint8_t *actions;
+    /**
+     * @brief Whether each cell has several greedy actions, 8 cells per byte
+     *
+     */
+    uint8_t *tied;
+    /**
+     * @brief Cells with several greedy actions, in increasing order
+     *
+     */
+    uint32_t *tie_cells;
+    /**
+     * @brief Bitmask of the greedy actions of each tied cell
+     *
+     */
+    uint8_t *tie_masks;
+    /**
+     * @brief Buffer holding all the arrays
+     *
+     */
+    void *data;
+    /**
+     * @brief Size of the buffer in bytes
+     *
+     */
+    size_t size;
+} Policy;
+
+/**
+ * @brief Compile the greedy policy of the Q-table of a map, the ties among the possible actions of each cell kept as bitmasks
+ *
+ * Wall cells, where the agent never stands, get UP without tie.
+ *
+ * @param policy Policy to initialize
+ * @param map Map containing the Q-table
+ * @return int 1 if success, 0 otherwise
+ */
+int compile_policy(Policy *policy, Map map);
+
+/**
+ * @brief Free a policy
+ *
+ * @param policy Policy
+ */
+void free_policy(Policy *policy);
+
+/**
+ * @brief Load a policy from a file, checked against the map
+ *
+ * @param policy Policy to initialize
+ * @param map Map the policy was compiled for
+ * @param filename Name of the file containing the policy
+ * @return int 1 if success, 0 otherwise
+ */
+int load_policy(Policy *policy, Map map, char *filename);
+
+/**
+ * @brief Save a policy to a file
+ *
+ * @param policy Policy
+ * @param filename Name of the file to save the policy
+ * @return int 1 if success, 0 otherwise
+ */
+int save_policy(Policy policy, char *filename);
+
+/**
+ * @brief Get the action of the policy in a cell, picking uniformly among the tied actions like choose_action()
+ *
+ * @param policy Policy
+ * @param random Random generator, only drawn from in tied cells
+ * @param cell Index of the cell
+ * @return enum Action Action
+ */
+static inline enum Action policy_action(Policy *policy, Random *random, int cell)
+{
+    if (!(policy->tied[cell >> 3] & 1 << (cell & 7)))
+    {
+        return policy->actions[cell >> 2] >> (cell & 3) * 2 & 3;
+    }
+    // the tied cells are few, a binary search finds their bitmask
+    int low = 0;
+    int high = policy->ties_count - 1;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (policy->tie_cells[middle] < (uint32_t)cell)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return pick_action(random, policy->tie_masks[low]);
+}
+
+/**
+ * @brief Test mode step following a policy instead of the Q-table, like q() in test mode
+ *
+ * @param map Map to use
+ * @param state Current state
+ * @param policy Policy
+ * @param params Parameters
+ * @return State Next state
+ */
+State act_policy(Map *map, State state, Policy *policy, Params params);
+
+#endif
@@ -10,11 +10,83 @@
 
 #include "q_learning.h"
 
-Map build_map(int teleporter)
+void *allocate_aligned(size_t size)
 {
-    // init random seed
-    srand(time(NULL));
+    // aligned_alloc requires a size multiple of the alignment
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    void *buffer = aligned_alloc(ALIGNMENT, size);
+    if (buffer != NULL)
+    {
+        memset(buffer, 0, size);
+    }
+    return buffer;
+}
+
+Map allocate_map(int width, int height, int sparse)
+{
+    Map map;
+    map.width = width;
+    map.height = height;
+    map.map = sparse ? NULL : allocate_aligned((size_t)width * height * sizeof(int));
+    map.sparse_map = sparse ? allocate_sparse_map(SPARSE_CAPACITY) : NULL;
+    map.q = sparse ? NULL : allocate_aligned((size_t)width * height * ACTIONS * sizeof(QValue));
+    map.sparse = sparse ? allocate_sparse(SPARSE_CAPACITY) : NULL;
+    map.mapping = NULL;
+    map.mapping_size = 0;
+    map.start.x = 0;
+    map.start.y = 0;
+    map.agent = map.start;
+    map.steps = 0;
+    map.epoch = 0;
+    map.landmarks = (Landmarks){NULL, 0, NULL, NULL, 0, NULL};
+    map.actions = sparse ? NULL : allocate_aligned((size_t)width * height);
+    map.transitions = NULL;
+    seed_random(&map.random, 0);
+    map.deltas = (Deltas){0, 0, 0, 0};
+    map.model = (Model){0};
+    map.replay = (Replay){0};
+    return map;
+}
+
+/**
+ * @brief Check if the buffers of an allocated map, dense or sparse, were all allocated
+ *
+ * @param map Map returned by allocate_map()
+ * @return int Status
+ */
+static int is_allocated(Map map)
+{
+    if (map.sparse_map != NULL)
+    {
+        return map.sparse != NULL;
+    }
+    return map.map != NULL && map.q != NULL && map.actions != NULL;
+}
 
+/**
+ * @brief Set the type of a cell, in the map buffer or the sparse map where empty cells are not stored
+ *
+ * @param map Map containing the cell
+ * @param cell Index of the cell
+ * @param type Type of the cell
+ * @return int Status
+ */
+static int set_cell_type(Map *map, int64_t cell, enum Type type)
+{
+    if ((*map).map != NULL)
+    {
+        (*map).map[cell] = type;
+        return 1;
+    }
+    if (type == EMPTY && find_sparse_map((*map).sparse_map, cell) == EMPTY)
+    {
+        return 1;
+    }
+    return insert_sparse_map((*map).sparse_map, cell, type);
+}
+
+int build_map(Map *map, int teleporter, int sparse)
+{
     // map initialization and memory allocation
     int teleporter_1 = 0;
     int teleporter_2 = 0;
@@ -23,13 +95,11 @@ Map build_map(int teleporter)
         teleporter_1 = TELEPORTER_1;
         teleporter_2 = TELEPORTER_2;
     }
-    Map map;
-    map.width = 6;
-    map.height = 6;
-    map.map = malloc(map.height * sizeof(int *));
-    for (int i = 0; i < 6; i++)
+    *map = allocate_map(6, 6, sparse);
+    if (!is_allocated(*map))
     {
-        map.map[i] = malloc(map.width * sizeof(int));
+        free_map(*map);
+        return 0;
     }
     int matrix[6][6] = {{EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, GOAL_1},
                         {GOAL_2, EMPTY, EMPTY, EMPTY, teleporter_2, EMPTY},
@@ -37,172 +107,1051 @@ Map build_map(int teleporter)
                         {EMPTY, EMPTY, WALL, WALL, WALL, WALL},
                         {EMPTY, EMPTY, WALL, teleporter_1, EMPTY, EMPTY},
                         {EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY}};
-    for (int i = 0; i < map.height; i++)
+    for (int i = 0; i < (*map).height; i++)
     {
-        for (int j = 0; j < map.width; j++)
+        for (int j = 0; j < (*map).width; j++)
         {
-            map.map[i][j] = matrix[i][j];
+            if (!set_cell_type(map, get_cell(*map, (State){j, i}), matrix[i][j]))
+            {
+                free_map(*map);
+                return 0;
+            }
         }
     }
-    map.q = malloc(map.height * sizeof(double **));
-    for (int i = 0; i < map.height; i++)
+    (*map).start.x = 5;
+    (*map).start.y = 5;
+    (*map).agent = (*map).start;
+    if (!index_map(map))
     {
-        map.q[i] = malloc(map.width * sizeof(double *));
-        for (int j = 0; j < map.width; j++)
+        free_map(*map);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Compare two cells by index, for qsort()
+ *
+ * @param a First cell
+ * @param b Second cell
+ * @return int Order of the cells
+ */
+static int compare_cells(const void *a, const void *b)
+{
+    int64_t cell_a = *(const int64_t *)a;
+    int64_t cell_b = *(const int64_t *)b;
+    return (cell_a > cell_b) - (cell_a < cell_b);
+}
+
+/**
+ * @brief List the goal and teleporter cells of the map in reading order
+ *
+ * A dense map is scanned cell by cell, the few cells of a sparse map are taken from its slots and sorted.
+ *
+ * @param map Map to scan
+ * @param count Number of cells listed
+ * @return int64_t* Listed cells, NULL on failure
+ */
+static int64_t *list_landmarks(Map map, size_t *count)
+{
+    *count = 0;
+    if (map.map == NULL)
+    {
+        SparseMap *sparse_map = map.sparse_map;
+        int64_t *cells = malloc((sparse_map->count + 1) * sizeof(int64_t));
+        if (cells == NULL)
+        {
+            return NULL;
+        }
+        for (size_t slot = 0; slot < sparse_map->capacity; slot++)
         {
-            map.q[i][j] = malloc(4 * sizeof(double));
-            for (int k = 0; k < 4; k++)
+            enum Type type = sparse_map->types[slot];
+            if (sparse_map->cells[slot] >= 0 && (type == GOAL_1 || type == GOAL_2 || type == TELEPORTER_1 || type == TELEPORTER_2))
             {
-                map.q[i][j][k] = 0;
+                cells[(*count)++] = sparse_map->cells[slot];
             }
         }
+        qsort(cells, *count, sizeof(int64_t), compare_cells);
+        return cells;
+    }
+
+    // counted first so that the list is allocated once
+    int64_t size = (int64_t)map.width * map.height;
+    for (int64_t i = 0; i < size; i++)
+    {
+        *count += map.map[i] == GOAL_1 || map.map[i] == GOAL_2 || map.map[i] == TELEPORTER_1 || map.map[i] == TELEPORTER_2;
+    }
+    int64_t *cells = malloc((*count + 1) * sizeof(int64_t));
+    if (cells == NULL)
+    {
+        return NULL;
+    }
+    *count = 0;
+    for (int64_t i = 0; i < size; i++)
+    {
+        if (map.map[i] == GOAL_1 || map.map[i] == GOAL_2 || map.map[i] == TELEPORTER_1 || map.map[i] == TELEPORTER_2)
+        {
+            cells[(*count)++] = i;
+        }
+    }
+    return cells;
+}
+
+int index_map(Map *map)
+{
+    Landmarks *landmarks = &(*map).landmarks;
+    int64_t size = (int64_t)(*map).width * (*map).height;
+
+    // actions that keep the agent inside the map, a sparse map derives them from the borders instead
+    for (int64_t i = 0; (*map).actions != NULL && i < size; i++)
+    {
+        State state = get_state(*map, i);
+        (*map).actions[i] = 0;
+        for (int action = 0; action < ACTIONS; action++)
+        {
+            if (check_state(*map, move_state(state, action)))
+            {
+                (*map).actions[i] |= 1 << action;
+            }
+        }
+    }
+
+    size_t count;
+    int64_t *cells = list_landmarks(*map, &count);
+    if (cells == NULL)
+    {
+        return 0;
+    }
+
+    // count the landmarks first so that each list is allocated once
+    int entrances = 0;
+    int exits = 0;
+    landmarks->goals_count = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        switch (get_cell_type(*map, cells[i]))
+        {
+        case GOAL_1:
+        case GOAL_2:
+            landmarks->goals_count++;
+            break;
+        case TELEPORTER_1:
+            entrances++;
+            break;
+        case TELEPORTER_2:
+            exits++;
+            break;
+        default:
+            break;
+        }
+    }
+    // an entrance without any exit does nothing, extra entrances share the last exit
+    landmarks->teleporters_count = exits > 0 ? entrances : 0;
+
+    landmarks->goals = malloc((landmarks->goals_count + 1) * sizeof(State));
+    landmarks->teleporters = malloc((landmarks->teleporters_count + 1) * sizeof(State));
+    landmarks->exits = malloc((landmarks->teleporters_count + 1) * sizeof(State));
+    landmarks->links = NULL;
+    if (landmarks->teleporters_count > 0 && (*map).map != NULL)
+    {
+        landmarks->links = malloc(size * sizeof(int));
+    }
+    if (landmarks->goals == NULL || landmarks->teleporters == NULL || landmarks->exits == NULL ||
+        (landmarks->teleporters_count > 0 && (*map).map != NULL && landmarks->links == NULL))
+    {
+        free(cells);
+        return 0;
+    }
+    for (int64_t i = 0; landmarks->links != NULL && i < size; i++)
+    {
+        landmarks->links[i] = -1;
+    }
+
+    int goal = 0;
+    int entrance = 0;
+    int exit = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        State state = get_state(*map, cells[i]);
+        switch (get_cell_type(*map, cells[i]))
+        {
+        case GOAL_1:
+        case GOAL_2:
+            landmarks->goals[goal++] = state;
+            break;
+        case TELEPORTER_1:
+            if (landmarks->teleporters_count > 0)
+            {
+                if (landmarks->links != NULL)
+                {
+                    landmarks->links[cells[i]] = entrance;
+                }
+                landmarks->teleporters[entrance++] = state;
+            }
+            break;
+        case TELEPORTER_2:
+            if (exit < landmarks->teleporters_count)
+            {
+                landmarks->exits[exit++] = state;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    for (; exit > 0 && exit < landmarks->teleporters_count; exit++)
+    {
+        landmarks->exits[exit] = landmarks->exits[exit - 1];
+    }
+    free(cells);
+    return 1;
+}
+
+/**
+ * @brief Get the type of a cell from its character in a map file
+ *
+ * @param c Character of the cell
+ * @param teleporter Enable teleporter
+ * @return enum Type Type of the cell, EMPTY for the starting position, VOID if the character is unknown
+ */
+static enum Type parse_type(int c, int teleporter)
+{
+    switch (c)
+    {
+    case '.':
+    case 'S':
+        return EMPTY;
+    case '#':
+        return WALL;
+    case 'G':
+        return GOAL_1;
+    case 'g':
+        return GOAL_2;
+    case 'T':
+        return teleporter ? TELEPORTER_1 : EMPTY;
+    case 't':
+        return teleporter ? TELEPORTER_2 : EMPTY;
+    default:
+        return VOID;
+    }
+}
+
+int load_map(Map *map, char *filename, int teleporter, int sparse)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    // the dimensions are checked before their product, which indexes the cells of the dense buffers with int
+    int width, height;
+    if (fscanf(file, "%d %d", &width, &height) != 2 || width <= 0 || height <= 0 || (!sparse && height > INT_MAX / width))
+    {
+        fclose(file);
+        return 0;
+    }
+    *map = allocate_map(width, height, sparse);
+    if (!is_allocated(*map))
+    {
+        free_map(*map);
+        fclose(file);
+        return 0;
+    }
+
+    // the cells are listed when the first one starts with a digit, none of the cell characters being one
+    int start = 0;
+    int c;
+    do
+    {
+        c = getc(file);
+    } while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+    ungetc(c, file);
+    int status = 1;
+    if (c >= '0' && c <= '9')
+    {
+        int x, y, read = 0;
+        char cell;
+        while (status && (read = fscanf(file, "%d %d %c", &x, &y, &cell)) == 3)
+        {
+            State state = {x, y};
+            enum Type type = parse_type(cell, teleporter);
+            status = check_state(*map, state) && type != VOID && set_cell_type(map, get_cell(*map, state), type);
+            if (cell == 'S')
+            {
+                (*map).start = state;
+                start = 1;
+            }
+        }
+        status = status && read == EOF;
+    }
+    else
+    {
+        // cells are streamed directly into the map buffer
+        int64_t cells = (int64_t)width * height;
+        for (int64_t i = 0; status && i < cells; i++)
+        {
+            do
+            {
+                c = getc(file);
+            } while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+
+            // unknown cell or end of file reached too early
+            enum Type type = parse_type(c, teleporter);
+            status = type != VOID && set_cell_type(map, i, type);
+            if (c == 'S')
+            {
+                (*map).start = get_state(*map, i);
+                start = 1;
+            }
+        }
+    }
+    fclose(file);
+
+    if (!status || !start || !index_map(map))
+    {
+        free_map(*map);
+        return 0;
+    }
+    (*map).agent = (*map).start;
+    return 1;
+}
+
+Sparse *allocate_sparse(size_t capacity)
+{
+    Sparse *sparse = malloc(sizeof(Sparse));
+    if (sparse == NULL)
+    {
+        return NULL;
+    }
+    sparse->cells = malloc(capacity * sizeof(int64_t));
+    sparse->values = malloc(capacity * ACTIONS * sizeof(QValue));
+    sparse->capacity = capacity;
+    sparse->count = 0;
+    if (sparse->cells == NULL || sparse->values == NULL)
+    {
+        free_sparse(sparse);
+        return NULL;
+    }
+    memset(sparse->cells, -1, capacity * sizeof(int64_t));
+    return sparse;
+}
+
+QValue *insert_sparse(Sparse *sparse, int64_t cell)
+{
+    // the slots are rehashed into a table twice as large, the old slots are only freed once moved
+    if (4 * (sparse->count + 1) > 3 * sparse->capacity)
+    {
+        Sparse *grown = allocate_sparse(2 * sparse->capacity);
+        if (grown == NULL)
+        {
+            fprintf(stderr, "Failed to grow the sparse Q-table to %zu states\n", 2 * sparse->capacity);
+            abort();
+        }
+        for (size_t slot = 0; slot < sparse->capacity; slot++)
+        {
+            if (sparse->cells[slot] >= 0)
+            {
+                memcpy(insert_sparse(grown, sparse->cells[slot]), &sparse->values[slot * ACTIONS], ACTIONS * sizeof(QValue));
+            }
+        }
+        free(sparse->cells);
+        free(sparse->values);
+        *sparse = *grown;
+        free(grown);
+    }
+
+    size_t mask = sparse->capacity - 1;
+    size_t slot = hash_cell(cell, mask);
+    while (sparse->cells[slot] >= 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+    sparse->cells[slot] = cell;
+    sparse->count++;
+    QValue *values = &sparse->values[slot * ACTIONS];
+    memset(values, 0, ACTIONS * sizeof(QValue));
+    return values;
+}
+
+int copy_sparse(Sparse *target, Sparse *source)
+{
+    if (target->capacity != source->capacity)
+    {
+        int64_t *cells = realloc(target->cells, source->capacity * sizeof(int64_t));
+        if (cells != NULL)
+        {
+            target->cells = cells;
+        }
+        QValue *values = realloc(target->values, source->capacity * ACTIONS * sizeof(QValue));
+        if (values != NULL)
+        {
+            target->values = values;
+        }
+        if (cells == NULL || values == NULL)
+        {
+            return 0;
+        }
+        target->capacity = source->capacity;
+    }
+    memcpy(target->cells, source->cells, source->capacity * sizeof(int64_t));
+    memcpy(target->values, source->values, source->capacity * ACTIONS * sizeof(QValue));
+    target->count = source->count;
+    return 1;
+}
+
+size_t sparse_memory(Sparse *sparse)
+{
+    return sizeof(Sparse) + sparse->capacity * (sizeof(int64_t) + ACTIONS * sizeof(QValue));
+}
+
+void free_sparse(Sparse *sparse)
+{
+    if (sparse != NULL)
+    {
+        free(sparse->cells);
+        free(sparse->values);
+        free(sparse);
+    }
+}
+
+SparseMap *allocate_sparse_map(size_t capacity)
+{
+    SparseMap *sparse_map = malloc(sizeof(SparseMap));
+    if (sparse_map == NULL)
+    {
+        return NULL;
+    }
+    sparse_map->cells = malloc(capacity * sizeof(int64_t));
+    sparse_map->types = malloc(capacity * sizeof(int16_t));
+    sparse_map->capacity = capacity;
+    sparse_map->count = 0;
+    if (sparse_map->cells == NULL || sparse_map->types == NULL)
+    {
+        free_sparse_map(sparse_map);
+        return NULL;
+    }
+    memset(sparse_map->cells, -1, capacity * sizeof(int64_t));
+    return sparse_map;
+}
+
+int insert_sparse_map(SparseMap *sparse_map, int64_t cell, enum Type type)
+{
+    // the slots are rehashed into a table twice as large, like the ones of a sparse Q-table
+    if (4 * (sparse_map->count + 1) > 3 * sparse_map->capacity)
+    {
+        SparseMap *grown = allocate_sparse_map(2 * sparse_map->capacity);
+        if (grown == NULL)
+        {
+            return 0;
+        }
+        for (size_t slot = 0; slot < sparse_map->capacity; slot++)
+        {
+            if (sparse_map->cells[slot] >= 0)
+            {
+                insert_sparse_map(grown, sparse_map->cells[slot], sparse_map->types[slot]);
+            }
+        }
+        free(sparse_map->cells);
+        free(sparse_map->types);
+        *sparse_map = *grown;
+        free(grown);
+    }
+
+    // a cell already stored only changes type
+    size_t mask = sparse_map->capacity - 1;
+    size_t slot = hash_cell(cell, mask);
+    while (sparse_map->cells[slot] >= 0 && sparse_map->cells[slot] != cell)
+    {
+        slot = (slot + 1) & mask;
+    }
+    sparse_map->count += sparse_map->cells[slot] < 0;
+    sparse_map->cells[slot] = cell;
+    sparse_map->types[slot] = type;
+    return 1;
+}
+
+enum Type find_sparse_map(SparseMap *sparse_map, int64_t cell)
+{
+    size_t mask = sparse_map->capacity - 1;
+    for (size_t slot = hash_cell(cell, mask);; slot = (slot + 1) & mask)
+    {
+        if (sparse_map->cells[slot] == cell)
+        {
+            return sparse_map->types[slot];
+        }
+        if (sparse_map->cells[slot] < 0)
+        {
+            return EMPTY;
+        }
+    }
+}
+
+size_t sparse_map_memory(SparseMap *sparse_map)
+{
+    return sizeof(SparseMap) + sparse_map->capacity * (sizeof(int64_t) + sizeof(int16_t));
+}
+
+void free_sparse_map(SparseMap *sparse_map)
+{
+    if (sparse_map != NULL)
+    {
+        free(sparse_map->cells);
+        free(sparse_map->types);
+        free(sparse_map);
     }
-    map.start.x = 5;
-    map.start.y = 5;
-    map.agent = map.start;
-    map.steps = 0;
-    map.epoch = 0;
-    return map;
 }
 
 void free_map(Map map)
 {
+    free(map.map);
+    free_sparse_map(map.sparse_map);
+    if (map.mapping != NULL)
+    {
+        munmap(map.mapping, map.mapping_size);
+    }
+    else
+    {
+        free(map.q);
+    }
+    free_sparse(map.sparse);
+    free(map.actions);
+    free(map.landmarks.goals);
+    free(map.landmarks.teleporters);
+    free(map.landmarks.exits);
+    free(map.landmarks.links);
+    free(map.transitions);
+    free(map.model.transitions);
+    free(map.model.observed);
+    free(map.model.predecessors);
+    free(map.model.links);
+    free(map.model.queue);
+    free(map.model.positions);
+    free(map.model.priorities);
+    free_replay(map.replay);
+}
+
+int check_state(Map map, State state)
+{
+    if (state.x < 0 || state.x >= map.width || state.y < 0 || state.y >= map.height)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+int are_states_equal(State state1, State state2)
+{
+    if (state1.x == state2.x && state1.y == state2.y)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+State find_state(Map map, enum Type type)
+{
+    State state = {-1, -1};
+
+    // landmarks are looked up in the index instead of scanning the map
+    switch (type)
+    {
+    case GOAL_1:
+    case GOAL_2:
+        for (int i = 0; i < map.landmarks.goals_count; i++)
+        {
+            if (get_type(map, map.landmarks.goals[i]) == type)
+            {
+                return map.landmarks.goals[i];
+            }
+        }
+        return state;
+    case TELEPORTER_1:
+        if (map.landmarks.teleporters_count > 0)
+        {
+            return map.landmarks.teleporters[0];
+        }
+        break;
+    case TELEPORTER_2:
+        if (map.landmarks.teleporters_count > 0)
+        {
+            return map.landmarks.exits[0];
+        }
+        break;
+    default:
+        break;
+    }
+
     for (int i = 0; i < map.height; i++)
     {
-        free(map.map[i]);
         for (int j = 0; j < map.width; j++)
         {
-            free(map.q[i][j]);
+            if (get_cell_type(map, get_cell(map, (State){j, i})) == type)
+            {
+                state.x = j;
+                state.y = i;
+                return state;
+            }
         }
-        free(map.q[i]);
     }
-    free(map.map);
-    free(map.q);
+    return state;
+}
+
+State find_exit(Map map, State state)
+{
+    if (map.landmarks.teleporters_count == 0 || !check_state(map, state))
+    {
+        return state;
+    }
+    if (map.landmarks.links != NULL)
+    {
+        int link = map.landmarks.links[get_cell(map, state)];
+        return link >= 0 ? map.landmarks.exits[link] : state;
+    }
+
+    // a sparse map has no link per cell, its entrances are in reading order so they are searched by cell
+    int64_t cell = get_cell(map, state);
+    int low = 0;
+    int high = map.landmarks.teleporters_count - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        int64_t entrance = get_cell(map, map.landmarks.teleporters[middle]);
+        if (entrance == cell)
+        {
+            return map.landmarks.exits[middle];
+        }
+        if (entrance < cell)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return state;
+}
+
+enum Type get_type(Map map, State state)
+{
+    // if the state does not belong to the map, we return VOID
+    if (!check_state(map, state))
+    {
+        return VOID;
+    }
+    return get_cell_type(map, get_cell(map, state));
+}
+
+double max_q(Map map, State state)
+{
+    return max_q_cell(map, get_cell(map, state));
+}
+
+double euclidean_distance(State state1, State state2)
+{
+    return sqrt(pow(state1.x - state2.x, 2) + pow(state1.y - state2.y, 2));
+}
+
+int get_reward(Map map, State state, State next_state, enum Type type, Params params)
+{
+    int reward = 0;
+    switch (type)
+    {
+    case EMPTY:
+        // if we are in euclidean mode, we add a reward based on the distance to the goals
+        if (params.euclidean)
+        {
+            // max distance possible on the map for normalization
+            double max_distance = euclidean_distance((State){0, 0}, (State){map.width - 1, map.height - 1});
+            // each goal is weighted by its reward, so the agent is encouraged to go to goal 1 rather than goal 2
+            double distance_reward = 0;
+            for (int i = 0; i < map.landmarks.goals_count; i++)
+            {
+                State goal = map.landmarks.goals[i];
+                distance_reward += (euclidean_distance(state, goal) - euclidean_distance(next_state, goal)) / max_distance * get_type(map, goal);
+            }
+            reward = distance_reward;
+        }
+        else
+        {
+            reward = EMPTY;
+        }
+        break;
+    case WALL:
+        reward = WALL;
+        break;
+    case GOAL_1:
+        reward = GOAL_1;
+        break;
+    case GOAL_2:
+        reward = GOAL_2;
+        break;
+    default:
+        break;
+    }
+    return reward;
+}
+
+int build_transitions(Map *map, Params params)
+{
+    if (!check_cells(*map))
+    {
+        return 0;
+    }
+    int size = (*map).width * (*map).height;
+    (*map).transitions = allocate_aligned((size_t)size * ACTIONS * sizeof(Transition));
+    if ((*map).transitions == NULL)
+    {
+        return 0;
+    }
+
+    for (int cell = 0; cell < size; cell++)
+    {
+        State state = get_state(*map, cell);
+        for (int action = 0; action < ACTIONS; action++)
+        {
+            Transition *transition = &(*map).transitions[(size_t)cell * ACTIONS + action];
+            State next_state = move_state(state, action);
+            enum Type type = get_type(*map, next_state);
+            if (type == VOID)
+            {
+                *transition = (Transition){-1, 0, 0};
+                continue;
+            }
+            if (params.teleporter && type == TELEPORTER_1)
+            {
+                next_state = find_exit(*map, next_state);
+            }
+            transition->next = get_cell(*map, next_state);
+            transition->reward = get_reward(*map, state, next_state, type, params);
+            transition->terminal = type == GOAL_1 || type == GOAL_2;
+        }
+    }
+    return 1;
+}
+
+int init_model(Map *map, int prioritized)
+{
+    size_t size = (size_t)(*map).width * (*map).height;
+    Model *model = &(*map).model;
+    *model = (Model){0};
+    // pairs of cell and action are indexed by int
+    if (size > INT_MAX / ACTIONS)
+    {
+        return 0;
+    }
+    model->transitions = malloc(size * ACTIONS * sizeof(Transition));
+    model->observed = malloc(size * ACTIONS * sizeof(int));
+    model->predecessors = malloc(size * sizeof(int));
+    model->links = malloc(size * ACTIONS * sizeof(int));
+    int status = model->transitions != NULL && model->observed != NULL && model->predecessors != NULL && model->links != NULL;
+    if (prioritized)
+    {
+        model->queue = malloc(size * ACTIONS * sizeof(int));
+        model->positions = malloc(size * ACTIONS * sizeof(int));
+        model->priorities = malloc(size * ACTIONS * sizeof(double));
+        status = status && model->queue != NULL && model->positions != NULL && model->priorities != NULL;
+    }
+    if (!status)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < size * ACTIONS; i++)
+    {
+        model->transitions[i] = (Transition){-1, 0, 0};
+        if (model->positions != NULL)
+        {
+            model->positions[i] = -1;
+        }
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        model->predecessors[i] = -1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Swap two pairs of the prioritized sweeping queue
+ *
+ * @param model Model containing the queue
+ * @param i Index of the first pair in the queue
+ * @param j Index of the second pair in the queue
+ */
+static void swap_queue(Model *model, int i, int j)
+{
+    int pair = model->queue[i];
+    model->queue[i] = model->queue[j];
+    model->queue[j] = pair;
+    model->positions[model->queue[i]] = i;
+    model->positions[model->queue[j]] = j;
 }
 
-int check_state(Map map, State state)
+/**
+ * @brief Queue a pair for a prioritized update, or raise its priority if already queued
+ *
+ * @param map Map containing the Q-table and the model
+ * @param pair Pair of cell and action
+ * @param params Parameters, with the priority threshold
+ */
+static void push_queue(Map *map, int pair, Params params)
 {
-    if (state.x < 0 || state.x >= map.width || state.y < 0 || state.y >= map.height)
+    Model *model = &map->model;
+    Transition transition = model->transitions[pair];
+    double priority = fabs(transition.reward + params.gamma * max_q_cell(*map, transition.next) - get_q(*map, pair / ACTIONS, pair % ACTIONS));
+    if (priority <= params.theta)
     {
-        return 0;
+        return;
     }
-    return 1;
-}
+    int i = model->positions[pair];
+    if (i < 0)
+    {
+        i = model->queue_count++;
+        model->queue[i] = pair;
+        model->positions[pair] = i;
+    }
+    else if (priority <= model->priorities[pair])
+    {
+        return;
+    }
+    model->priorities[pair] = priority;
 
-int are_states_equal(State state1, State state2)
-{
-    if (state1.x == state2.x && state1.y == state2.y)
+    // sift up
+    while (i > 0 && model->priorities[model->queue[(i - 1) / 2]] < priority)
     {
-        return 1;
+        swap_queue(model, i, (i - 1) / 2);
+        i = (i - 1) / 2;
     }
-    return 0;
 }
 
-State find_state(Map map, enum Type type)
+/**
+ * @brief Remove the pair with the largest priority from the queue
+ *
+ * @param model Model containing the queue, not empty
+ * @return int Pair of cell and action
+ */
+static int pop_queue(Model *model)
 {
-    State state = {-1, -1};
-    for (int i = 0; i < map.height; i++)
+    int pair = model->queue[0];
+    swap_queue(model, 0, --model->queue_count);
+    model->positions[pair] = -1;
+
+    // sift down
+    int i = 0;
+    while (1)
     {
-        for (int j = 0; j < map.width; j++)
+        int largest = i;
+        for (int child = 2 * i + 1; child <= 2 * i + 2 && child < model->queue_count; child++)
         {
-            if (map.map[i][j] == type)
+            if (model->priorities[model->queue[child]] > model->priorities[model->queue[largest]])
             {
-                state.x = j;
-                state.y = i;
-                return state;
+                largest = child;
             }
         }
+        if (largest == i)
+        {
+            break;
+        }
+        swap_queue(model, i, largest);
+        i = largest;
     }
-    return state;
+    return pair;
 }
 
-enum Type get_type(Map map, State state)
+/**
+ * @brief Apply the update of q() to a pair from its transition in the model
+ *
+ * @param map Map containing the Q-table and the model
+ * @param pair Pair of cell and action
+ * @param alpha Learning rate of the update
+ * @param params Parameters
+ */
+static void replay(Map *map, int pair, double alpha, Params params)
 {
-    // if the state does not belong to the map, we return VOID
-    if (!check_state(map, state))
+    int cell = pair / ACTIONS;
+    enum Action action = pair % ACTIONS;
+    Transition transition = map->model.transitions[pair];
+    double old = get_q(*map, cell, action);
+    set_q(*map, cell, action, (1 - alpha) * old + alpha * (transition.reward + params.gamma * max_q_cell(*map, transition.next)));
+    if (params.tolerance > 0)
     {
-        return VOID;
+        track_update(&map->deltas, *map, cell, get_actions(*map, cell), action, old, params.tolerance);
     }
-    return map.map[state.y][state.x];
 }
 
-int max_q(Map map, State state)
+void plan(Map *map, int cell, enum Action action, int reward, int next, Params params)
 {
-    int max_q = -10;
-    for (int i = 0; i < 4; i++)
+    Model *model = &map->model;
+    int pair = cell * ACTIONS + action;
+    if (model->transitions[pair].next < 0)
+    {
+        // pairs are linked to the first cell they lead to, which is the only one on a static map
+        model->observed[model->observed_count++] = pair;
+        model->links[pair] = model->predecessors[next];
+        model->predecessors[next] = pair;
+    }
+    model->transitions[pair] = (Transition){next, reward, 0};
+
+    if (model->queue == NULL)
     {
-        if (map.q[state.y][state.x][i] > max_q)
+        for (int i = 0; i < params.dyna; i++)
         {
-            max_q = map.q[state.y][state.x][i];
+            replay(map, model->observed[random_int(&map->random, model->observed_count)], params.alpha, params);
         }
+        return;
     }
-    return max_q;
-}
 
-double euclidean_distance(State state1, State state2)
-{
-    return sqrt(pow(state1.x - state2.x, 2) + pow(state1.y - state2.y, 2));
+    // prioritized sweeping, the predecessors of each updated cell are queued with their new TD error
+    // the model is deterministic, so a queued pair takes its whole TD error at once instead of a fraction alpha of it
+    push_queue(map, pair, params);
+    for (int i = 0; i < params.dyna && model->queue_count > 0; i++)
+    {
+        int updated = pop_queue(model);
+        replay(map, updated, 1, params);
+        for (int predecessor = model->predecessors[updated / ACTIONS]; predecessor >= 0; predecessor = model->links[predecessor])
+        {
+            push_queue(map, predecessor, params);
+        }
+    }
 }
 
-State q(Map *map, State state, Params params)
+enum Action choose_action(Map *map, int64_t cell, Params params)
 {
-    // choose next action
-    enum Action next_action;
-    double max = -10;
-    for (int i = 0; i < 4; i++)
+    // choose next action among the possible ones, if there are several max values, we choose one randomly
+    INSTRUMENT_START(select_start);
+    int actions = get_actions(*map, cell);
+    INSTRUMENT_COUNT(STEPS, 1);
+    int votes = 0;
+    double max = 0;
+    for (int i = 0; i < ACTIONS; i++)
     {
-        double value = map->q[state.y][state.x][i];
-        if (value > max)
+        if (!(actions & 1 << i))
+        {
+            continue;
+        }
+        double value = get_q(*map, cell, i);
+        if (votes == 0 || value > max)
         {
             max = value;
-            next_action = i;
+            votes = 1 << i;
+        }
+        else if (value == max)
+        {
+            votes |= 1 << i;
         }
     }
+    enum Action next_action = pick_action(&map->random, votes);
+    INSTRUMENT_STOP(select_start, SELECT);
 
-    // if there are several max values, we choose one randomly
-    int vote[4] = {0};
-    int count = 0;
-    for (int i = 0; i < 4; i++)
+    // only in training mode
+    if (!params.test)
     {
-        if ((*map).q[state.y][state.x][i] == max && get_type(*map, move_state(state, i)) != VOID)
-        {
-            vote[i] = 1;
-            count++;
-        }
+        INSTRUMENT_START(explore_start);
+        next_action = epsilon_greedy(&map->random, next_action, actions, params.epsilon);
+        INSTRUMENT_STOP(explore_start, EXPLORE);
     }
+    return next_action;
+}
 
-    if (count > 0)
+State step_state(Map *map, State state, enum Action action, Params params, int *reward)
+{
+    INSTRUMENT_START(reward_start);
+    State next_state;
+    *reward = 0;
+    if (map->transitions != NULL)
+    {
+        // teleporters and rewards are already resolved in the transition table
+        Transition transition = map->transitions[(size_t)get_cell(*map, state) * ACTIONS + action];
+        next_state = get_state(*map, transition.next);
+        *reward = transition.reward;
+        INSTRUMENT_COUNT(WALL_BUMPS, transition.next >= 0 && get_cell_type(*map, transition.next) == WALL);
+        INSTRUMENT_COUNT(OFF_MAP, transition.next < 0);
+        INSTRUMENT_COUNT(TELEPORTS, params.teleporter && get_type(*map, move_state(state, action)) == TELEPORTER_1);
+    }
+    else
     {
-        int random_count = rand() % count;
-        count = 0;
-        for (int i = 0; i < 4; i++)
+        next_state = move_state(state, action);
+        enum Type type = get_type(*map, next_state);
+        INSTRUMENT_COUNT(WALL_BUMPS, type == WALL);
+        INSTRUMENT_COUNT(OFF_MAP, type == VOID);
+
+        // if the agent is on a teleporter, we move it to the other teleporter
+        if (params.teleporter && type == TELEPORTER_1)
         {
-            if (vote[i] == 1)
-            {
-                if (count == random_count)
-                {
-                    next_action = i;
-                    break;
-                }
-                count++;
-            }
+            next_state = find_exit(*map, next_state);
+            INSTRUMENT_COUNT(TELEPORTS, 1);
+        }
+
+        // no need to calculate the reward in test mode
+        if (!params.test)
+        {
+            *reward = get_reward(*map, state, next_state, type, params);
         }
     }
+    INSTRUMENT_STOP(reward_start, REWARD);
+    return next_state;
+}
 
-    // only in training mode
-    if (!params.test)
+void update_q(Map *map, int64_t cell, enum Action action, int reward, int64_t next, Params params)
+{
+    INSTRUMENT_START(update_start);
+    double old = get_q(*map, cell, action);
+    set_q(*map, cell, action, (1 - params.alpha) * old + params.alpha * (reward + params.gamma * max_q_cell(*map, next)));
+    if (params.tolerance > 0)
+    {
+        track_update(&map->deltas, *map, cell, get_actions(*map, cell), action, old, params.tolerance);
+    }
+    if (map->model.transitions != NULL)
     {
-        next_action = epsilon_greedy(*map, next_action, params.epsilon);
+        // the model is only allocated for maps whose pairs are indexed by int
+        plan(map, (int)cell, action, reward, (int)next, params);
     }
+    INSTRUMENT_STOP(update_start, UPDATE);
+}
 
-    State next_state = move_state(state, next_action);
-    enum Type type = get_type(*map, next_state);
+void learn_replay(Map *map, Params params)
+{
+    INSTRUMENT_START(update_start);
+    Replay *replay = &map->replay;
+    replay->pending = 0;
+    sample_replay(replay, &map->random);
+
+    // TD targets of the minibatch, from the Q-table before the minibatch
+    for (int k = 0; k < replay->batch; k++)
+    {
+        int i = replay->samples[k];
+        replay->targets[k] = replay->rewards[i] + params.gamma * max_q_cell(*map, replay->next[i]);
+    }
 
-    // if the agent is on a teleporter, we move it to the other teleporter
-    if (params.teleporter && type == TELEPORTER_1)
+    // updates in minibatch order, so that a transition sampled twice is applied twice
+    for (int k = 0; k < replay->batch; k++)
     {
-        next_state = find_state(*map, TELEPORTER_2);
+        int i = replay->samples[k];
+        int64_t cell = replay->cells[i];
+        enum Action action = replay->actions[i];
+        double old = get_q(*map, cell, action);
+        double error = replay->targets[k] - old;
+        set_q(*map, cell, action, old + params.alpha * replay->weights[k] * error);
+        if (params.tolerance > 0)
+        {
+            track_update(&map->deltas, *map, cell, get_actions(*map, cell), action, old, params.tolerance);
+        }
+        if (replay->tree != NULL)
+        {
+            set_priority(replay, i, error);
+        }
     }
+    INSTRUMENT_STOP(update_start, UPDATE);
+}
+
+State q(Map *map, State state, Params params)
+{
+    int64_t cell = get_cell(*map, state);
+    enum Action action = choose_action(map, cell, params);
+    int reward;
+    State next_state = step_state(map, state, action, params, &reward);
 
     // no need to update the Q-table if we are in test mode
     if (params.test)
@@ -210,42 +1159,18 @@ State q(Map *map, State state, Params params)
         return next_state;
     }
 
-    // reward calculation
-    int reward = 0;
-    switch (type)
+    // with experience replay, the transition waits in the buffer and a minibatch is learned every batch steps
+    if (map->replay.size > 0)
     {
-    case EMPTY:
-        // if we are in euclidean mode, we add a reward based on the distance to the goals
-        if (params.euclidean)
-        {
-            // max distance possible on the map for normalization
-            double max_distance = euclidean_distance((State){0, 0}, (State){map->width - 1, map->height - 1});
-            State goal_1 = find_state(*map, GOAL_1);
-            State goal_2 = find_state(*map, GOAL_2);
-            // reward for the first goal is higher than the second one to encourage the agent to go to the first one
-            reward = ((euclidean_distance(state, goal_1) - euclidean_distance(next_state, goal_1)) / max_distance * 1000) +
-                     ((euclidean_distance(state, goal_2) - euclidean_distance(next_state, goal_2)) / max_distance * 50);
-        }
-        else
+        push_replay(&map->replay, cell, action, reward, get_cell(*map, next_state));
+        if (map->replay.pending >= map->replay.batch)
         {
-            reward = EMPTY;
+            learn_replay(map, params);
         }
-        break;
-    case WALL:
-        reward = WALL;
-        break;
-    case GOAL_1:
-        reward = GOAL_1;
-        break;
-    case GOAL_2:
-        reward = GOAL_2;
-        break;
-    default:
-        break;
+        return next_state;
     }
 
-    // Q-table update
-    (*map).q[state.y][state.x][next_action] = (1 - params.alpha) * map->q[state.y][state.x][next_action] + params.alpha * (reward + params.gamma * max_q(*map, next_state));
+    update_q(map, cell, action, reward, get_cell(*map, next_state), params);
     return next_state;
 }
 
@@ -274,29 +1199,271 @@ State move_state(State state, enum Action action)
 
 int check_action(Map map, enum Action action)
 {
-    State new_state = move_state(map.agent, action);
-    if (get_type(map, new_state) != VOID)
+    return get_actions(map, get_cell(map, map.agent)) >> action & 1;
+}
+
+enum Action epsilon_greedy(Random *random, enum Action action, int actions, float epsilon)
+{
+    // exploration only draws among the possible actions, so no retry is needed
+    if (random_float(random) < epsilon)
     {
-        return 1;
+        INSTRUMENT_COUNT(RANDOM_ACTIONS, 1);
+        return pick_action(random, actions);
     }
-    return 0;
+    return action;
+}
+
+uint64_t checksum_q(const void *q, size_t size)
+{
+    const uint64_t *words = q;
+    uint64_t checksum = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size / sizeof(uint64_t); i++)
+    {
+        checksum ^= words[i];
+        checksum *= 0x100000001b3;
+    }
+    return checksum;
+}
+
+int is_binary(char *filename)
+{
+    size_t length = strlen(filename);
+    size_t extension = strlen(Q_EXTENSION);
+    return length >= extension && strcmp(filename + length - extension, Q_EXTENSION) == 0;
 }
 
-enum Action epsilon_greedy(Map map, enum Action action, float epsilon)
+/**
+ * @brief Get the size of a Q-value stored in a binary Q-table file
+ *
+ * @param type Type of the Q-values
+ * @return size_t Size in bytes, 0 if the type is unknown
+ */
+static size_t q_type_size(uint32_t type)
 {
-    enum Action next_action = action;
-    float random = (float)rand() / RAND_MAX;
-    if (random <= epsilon)
+    switch (type)
     {
-        next_action = rand() % 4;
+    case Q_DOUBLE:
+        return sizeof(double);
+    case Q_FLOAT:
+        return sizeof(float);
+    case Q_INT16:
+        return sizeof(int16_t);
+    default:
+        return 0;
     }
+}
 
-    // if the action is not possible, we choose another one
-    if (!check_action(map, next_action))
+/**
+ * @brief Get a Q-value of a binary Q-table file as a double
+ *
+ * @param values Q-values following the header
+ * @param type Type of the Q-values
+ * @param i Index of the Q-value
+ * @return double Q-value
+ */
+static double read_q_value(const void *values, uint32_t type, size_t i)
+{
+    switch (type)
     {
-        next_action = epsilon_greedy(map, action, epsilon);
+    case Q_DOUBLE:
+        return ((const double *)values)[i];
+    case Q_FLOAT:
+        return ((const float *)values)[i];
+    default:
+        return (double)((const int16_t *)values)[i] / Q_SCALE;
     }
-    return next_action;
+}
+
+/**
+ * @brief Get the size of the data following the header of a binary Q-table file
+ *
+ * @param map Map of the Q-table
+ * @param header Header of the file
+ * @return size_t Size in bytes, 0 if the type is unknown
+ */
+static size_t q_data_size(Map map, QHeader header)
+{
+    switch (header.sparse)
+    {
+    case Q_DENSE:
+        break;
+    case Q_SPARSE_32:
+        // the cells are padded to 8 bytes so that the checksum covers whole words
+        return (size_t)(header.states + 1) / 2 * 2 * sizeof(uint32_t) + (size_t)header.states * ACTIONS * q_type_size(header.type);
+    case Q_SPARSE_64:
+        return (size_t)header.states * (sizeof(uint64_t) + ACTIONS * q_type_size(header.type));
+    default:
+        return 0;
+    }
+    return (size_t)map.width * map.height * ACTIONS * q_type_size(header.type);
+}
+
+/**
+ * @brief Copy the Q-values of a binary Q-table file that cannot be mapped into the Q-table of the map
+ *
+ * This is the case of files holding another type of Q-values than this build, of sparse files and of sparse Q-tables.
+ *
+ * @param map Map to store the loaded Q-table
+ * @param header Header of the file, followed by the Q-values
+ * @return int Status
+ */
+static int convert_q(Map *map, QHeader *header)
+{
+    uint64_t cells_count = (uint64_t)(*map).width * (*map).height;
+    const uint32_t *cells_32 = (const uint32_t *)(header + 1);
+    const uint64_t *cells_64 = (const uint64_t *)(header + 1);
+    const void *values = header + 1;
+    uint64_t states = cells_count;
+    if (header->sparse != Q_DENSE)
+    {
+        values = header->sparse == Q_SPARSE_32 ? (const void *)(cells_32 + (header->states + 1) / 2 * 2) : (const void *)(cells_64 + header->states);
+        states = header->states;
+        for (uint64_t i = 0; i < states; i++)
+        {
+            if ((header->sparse == Q_SPARSE_32 ? cells_32[i] : cells_64[i]) >= cells_count)
+            {
+                return 0;
+            }
+        }
+    }
+
+    // the previous Q-table is emptied, a mapped one is replaced by an allocated one
+    if ((*map).sparse != NULL)
+    {
+        memset((*map).sparse->cells, -1, (*map).sparse->capacity * sizeof(int64_t));
+        (*map).sparse->count = 0;
+    }
+    else
+    {
+        QValue *q = (*map).mapping != NULL ? allocate_aligned(cells_count * ACTIONS * sizeof(QValue)) : (*map).q;
+        if (q == NULL)
+        {
+            return 0;
+        }
+        if ((*map).mapping != NULL)
+        {
+            munmap((*map).mapping, (*map).mapping_size);
+            (*map).mapping = NULL;
+            (*map).mapping_size = 0;
+            (*map).q = q;
+        }
+        memset(q, 0, cells_count * ACTIONS * sizeof(QValue));
+    }
+
+    for (uint64_t i = 0; i < states; i++)
+    {
+        int64_t cell = header->sparse == Q_DENSE ? (int64_t)i : header->sparse == Q_SPARSE_32 ? (int64_t)cells_32[i] : (int64_t)cells_64[i];
+        for (int action = 0; action < ACTIONS; action++)
+        {
+            set_q(*map, cell, action, read_q_value(values, header->type, i * ACTIONS + action));
+        }
+    }
+    (*map).epoch = header->epoch;
+    return 1;
+}
+
+/**
+ * @brief Memory-map a binary Q-table file and use it as the Q-table of the map
+ *
+ * Files holding another type of Q-values than this build or only the stored states of a sparse Q-table,
+ * and files loaded into a sparse Q-table, are copied instead.
+ *
+ * @param map Map to store the loaded Q-table
+ * @param filename Name of the file containing the Q-table
+ * @return int Status
+ */
+static int load_q_binary(Map *map, char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    struct stat st;
+    QHeader peek;
+    if (fstat(fd, &st) != 0 || read(fd, &peek, sizeof(QHeader)) != sizeof(QHeader) || q_type_size(peek.type) == 0 || peek.sparse > Q_SPARSE_64)
+    {
+        close(fd);
+        return 0;
+    }
+    size_t size = q_data_size(*map, peek);
+    if ((size_t)st.st_size != sizeof(QHeader) + size)
+    {
+        close(fd);
+        return 0;
+    }
+
+    // private mapping: pages are only copied when the Q-table is updated, the file is never modified
+    void *mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return 0;
+    }
+    QHeader *header = mapping;
+    if (memcmp(header->magic, Q_MAGIC, 4) != 0 || header->version != Q_VERSION || header->width != (uint32_t)(*map).width ||
+        header->height != (uint32_t)(*map).height || header->actions != ACTIONS || header->checksum != checksum_q(header + 1, size))
+    {
+        munmap(mapping, st.st_size);
+        return 0;
+    }
+    if (header->type != Q_TYPE || header->sparse != Q_DENSE || (*map).sparse != NULL)
+    {
+        int status = convert_q(map, header);
+        munmap(mapping, st.st_size);
+        return status;
+    }
+
+    // the previous Q-table is replaced by the mapped one
+    if ((*map).mapping != NULL)
+    {
+        munmap((*map).mapping, (*map).mapping_size);
+    }
+    else
+    {
+        free((*map).q);
+    }
+    (*map).q = (QValue *)(header + 1);
+    (*map).mapping = mapping;
+    (*map).mapping_size = st.st_size;
+    (*map).epoch = header->epoch;
+    return 1;
+}
+
+/**
+ * @brief Write the stored states of a sparse Q-table in binary format
+ *
+ * @param map Map containing the sparse Q-table
+ * @param file File to write
+ * @return int Status
+ */
+static int save_sparse(Map map, FILE *file)
+{
+    Sparse *sparse = map.sparse;
+    QHeader header = {Q_MAGIC, Q_VERSION, map.width, map.height, ACTIONS, Q_TYPE, map.epoch, 0, Q_SPARSE_64, sparse->count, {0}};
+    size_t size = q_data_size(map, header);
+    uint64_t *cells = calloc(1, size > 0 ? size : 1);
+    if (cells == NULL)
+    {
+        return 0;
+    }
+
+    // the states are written in slot order, which keeps the cells and their Q-values together without sorting
+    QValue *values = (QValue *)(cells + sparse->count);
+    size_t state = 0;
+    for (size_t slot = 0; slot < sparse->capacity; slot++)
+    {
+        if (sparse->cells[slot] >= 0)
+        {
+            cells[state] = sparse->cells[slot];
+            memcpy(&values[state * ACTIONS], &sparse->values[slot * ACTIONS], ACTIONS * sizeof(QValue));
+            state++;
+        }
+    }
+    header.checksum = checksum_q(cells, size);
+    int status = fwrite(&header, sizeof(QHeader), 1, file) == 1 && (size == 0 || fwrite(cells, size, 1, file) == 1);
+    free(cells);
+    return status;
 }
 
 int load_q(Map *map, char *filename)
@@ -307,13 +1474,33 @@ int load_q(Map *map, char *filename)
         return 0;
     }
 
-    fscanf(file, "%d\n", &(*map).epoch);
+    // binary files are recognized by their magic number
+    char magic[4];
+    if (fread(magic, 1, 4, file) == 4 && memcmp(magic, Q_MAGIC, 4) == 0)
+    {
+        fclose(file);
+        return load_q_binary(map, filename);
+    }
+    rewind(file);
 
-    for (int i = 0; i < (*map).height; i++)
+    if (fscanf(file, "%d\n", &(*map).epoch) != 1)
     {
-        for (int j = 0; j < (*map).width; j++)
+        fclose(file);
+        return 0;
+    }
+
+    int64_t cells = (int64_t)(*map).width * (*map).height;
+    for (int64_t i = 0; i < cells; i++)
+    {
+        double q[ACTIONS];
+        if (fscanf(file, "%lf %lf %lf %lf\n", &q[0], &q[1], &q[2], &q[3]) != 4)
+        {
+            fclose(file);
+            return 0;
+        }
+        for (int action = 0; action < ACTIONS; action++)
         {
-            fscanf(file, "%lf %lf %lf %lf\n", &(*map).q[i][j][0], &(*map).q[i][j][1], &(*map).q[i][j][2], &(*map).q[i][j][3]);
+            set_q(*map, i, action, q[action]);
         }
     }
 
@@ -329,16 +1516,49 @@ int save_q(Map map, char *filename)
         return 0;
     }
 
+    if (is_binary(filename) && map.sparse != NULL)
+    {
+        int status = save_sparse(map, file);
+        return fclose(file) == 0 && status;
+    }
+    if (is_binary(filename))
+    {
+        size_t size = (size_t)map.width * map.height * ACTIONS * sizeof(QValue);
+        QHeader header = {Q_MAGIC, Q_VERSION, map.width, map.height, ACTIONS, Q_TYPE, map.epoch, checksum_q(map.q, size), 0, 0, {0}};
+        int status = fwrite(&header, sizeof(QHeader), 1, file) == 1 && fwrite(map.q, size, 1, file) == 1;
+        return fclose(file) == 0 && status;
+    }
+
     fprintf(file, "%d\n", map.epoch);
 
-    for (int i = 0; i < map.height; i++)
+    int64_t cells = (int64_t)map.width * map.height;
+    for (int64_t i = 0; i < cells; i++)
     {
-        for (int j = 0; j < map.width; j++)
-        {
-            fprintf(file, "%lf %lf %lf %lf\n", map.q[i][j][0], map.q[i][j][1], map.q[i][j][2], map.q[i][j][3]);
-        }
+        fprintf(file, "%lf %lf %lf %lf\n", get_q(map, i, UP), get_q(map, i, DOWN), get_q(map, i, LEFT), get_q(map, i, RIGHT));
     }
 
     fclose(file);
     return 1;
-}
\ No newline at end of file
+}
+
+int greedy_path(Map map, Params params)
+{
+    params.test = 1;
+    map.agent = map.start;
+    int64_t cells = (int64_t)map.width * map.height;
+    int limit = cells < INT_MAX ? cells : INT_MAX;
+    for (int steps = 1; steps <= limit; steps++)
+    {
+        State next_state = q(&map, map.agent, params);
+        if (get_type(map, next_state) != WALL)
+        {
+            map.agent = next_state;
+        }
+        enum Type type = get_type(map, map.agent);
+        if (type == GOAL_1 || type == GOAL_2)
+        {
+            return steps;
+        }
+    }
+    return -1;
+}
@@ -12,9 +12,49 @@
 #define Q_LEARNING_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <time.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "params.h"
+#include "random.h"
+#include "instrument.h"
+#include "replay.h"
+
+/**
+ * @brief Number of actions available in each cell
+ *
+ */
+#define ACTIONS 4
+/**
+ * @brief Alignment in bytes of the map and Q-table buffers
+ *
+ */
+#define ALIGNMENT 64
+/**
+ * @brief Magic number at the start of binary Q-table files
+ *
+ */
+#define Q_MAGIC "QTBL"
+/**
+ * @brief Version of the binary Q-table format
+ *
+ */
+#define Q_VERSION 1
+/**
+ * @brief Extension of the files saved in the binary Q-table format
+ *
+ */
+#define Q_EXTENSION ".bin"
+/**
+ * @brief Initial number of slots of a sparse Q-table, a power of two
+ *
+ */
+#define SPARSE_CAPACITY 1024
 
 /**
  * @brief Cell types of the map
@@ -87,6 +127,197 @@ enum Action
     RIGHT = 3
 };
 
+/**
+ * @brief Types of the Q-values stored in binary Q-table files
+ *
+ */
+enum QType
+{
+    /**
+     * @brief 64-bit floating point
+     *
+     */
+    Q_DOUBLE = 0,
+    /**
+     * @brief 32-bit floating point
+     *
+     */
+    Q_FLOAT = 1,
+    /**
+     * @brief 16-bit integer holding the Q-value times Q_SCALE
+     *
+     */
+    Q_INT16 = 2
+};
+
+/**
+ * @brief Fixed point scale of 16-bit Q-values, which cover -2048 to 2048 by steps of 1 / Q_SCALE
+ *
+ */
+#define Q_SCALE 16
+
+#if defined(QTYPE_FLOAT)
+/**
+ * @brief Type of the Q-values in memory, selected at compile time with make QTYPE=double|float|int16
+ *
+ */
+typedef float QValue;
+/**
+ * @brief Type of the Q-values of this build, written in binary Q-table files
+ *
+ */
+#define Q_TYPE Q_FLOAT
+#elif defined(QTYPE_INT16)
+typedef int16_t QValue;
+#define Q_TYPE Q_INT16
+#else
+#define QTYPE_DOUBLE
+typedef double QValue;
+#define Q_TYPE Q_DOUBLE
+#endif
+
+/**
+ * @brief Layouts of the Q-values stored in binary Q-table files
+ *
+ */
+enum QLayout
+{
+    /**
+     * @brief Q-values of every cell
+     *
+     */
+    Q_DENSE = 0,
+    /**
+     * @brief Q-values of the stored states of a sparse Q-table, after their 32-bit cells padded to 8 bytes, written by earlier versions
+     *
+     */
+    Q_SPARSE_32 = 1,
+    /**
+     * @brief Q-values of the stored states of a sparse Q-table, after their 64-bit cells
+     *
+     */
+    Q_SPARSE_64 = 2
+};
+
+/**
+ * @brief Header of binary Q-table files, followed by the Q-values in the same layout as Map.q
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Magic number, Q_MAGIC
+     *
+     */
+    char magic[4];
+    /**
+     * @brief Version of the format, Q_VERSION
+     *
+     */
+    uint32_t version;
+    /**
+     * @brief Width of the map
+     *
+     */
+    uint32_t width;
+    /**
+     * @brief Height of the map
+     *
+     */
+    uint32_t height;
+    /**
+     * @brief Number of actions per cell
+     *
+     */
+    uint32_t actions;
+    /**
+     * @brief Type of the Q-values
+     *
+     */
+    uint32_t type;
+    /**
+     * @brief Epoch counter
+     *
+     */
+    int64_t epoch;
+    /**
+     * @brief Checksum of the Q-values
+     *
+     */
+    uint64_t checksum;
+    /**
+     * @brief Layout of the Q-values, whether only the stored states of a sparse Q-table follow
+     *
+     */
+    uint32_t sparse;
+    /**
+     * @brief Number of states following a sparse header
+     *
+     */
+    uint32_t states;
+    /**
+     * @brief Padding so that the Q-values are aligned on ALIGNMENT bytes
+     *
+     */
+    char reserved[ALIGNMENT - 48];
+} QHeader;
+
+/**
+ * @brief Structure representing a sparse Q-table, an open addressing hash table from cells to their Q-values
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Cell of each slot, -1 for empty slots
+     *
+     */
+    int64_t *cells;
+    /**
+     * @brief Q-values of each slot, stored slot by slot like Map.q
+     *
+     */
+    QValue *values;
+    /**
+     * @brief Number of slots, a power of two
+     *
+     */
+    size_t capacity;
+    /**
+     * @brief Number of states stored
+     *
+     */
+    size_t count;
+} Sparse;
+
+/**
+ * @brief Structure representing the cells of a sparse map other than empty ones, an open addressing hash table from cells to their types
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Cell of each slot, -1 for empty slots
+     *
+     */
+    int64_t *cells;
+    /**
+     * @brief Type of each slot
+     *
+     */
+    int16_t *types;
+    /**
+     * @brief Number of slots, a power of two
+     *
+     */
+    size_t capacity;
+    /**
+     * @brief Number of cells stored
+     *
+     */
+    size_t count;
+} SparseMap;
+
 /**
  * @brief Structure representing a state or a position in the map
  *
@@ -105,6 +336,148 @@ typedef struct
     int y;
 } State;
 
+/**
+ * @brief Structure indexing the notable cells of the map, built once when the map is loaded
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Positions of every goal cell, in reading order
+     *
+     */
+    State *goals;
+    /**
+     * @brief Number of goal cells
+     *
+     */
+    int goals_count;
+    /**
+     * @brief Positions of every teleporter 1 cell (entrance), in reading order
+     *
+     */
+    State *teleporters;
+    /**
+     * @brief Positions of the teleporter 2 cell (exit) paired with each entrance
+     *
+     */
+    State *exits;
+    /**
+     * @brief Number of teleporter pairs
+     *
+     */
+    int teleporters_count;
+    /**
+     * @brief Index of the teleporter pair of each cell, -1 if the cell is not an entrance, NULL without teleporter or on a sparse map
+     *
+     */
+    int *links;
+} Landmarks;
+
+/**
+ * @brief Structure representing the precomputed outcome of an action taken in a cell
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Index of the cell reached, after teleportation, -1 if the action leaves the map
+     *
+     */
+    int next;
+    /**
+     * @brief Reward of the action
+     *
+     */
+    int reward;
+    /**
+     * @brief Whether the cell reached is a goal
+     *
+     */
+    unsigned char terminal;
+} Transition;
+
+/**
+ * @brief Structure containing the transitions observed by the agent, replayed by Dyna-Q planning updates
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Last observed transition of each pair of cell and action, next is -1 while not observed
+     *
+     */
+    Transition *transitions;
+    /**
+     * @brief Observed pairs of cell and action (cell * ACTIONS + action), in order of first observation
+     *
+     */
+    int *observed;
+    /**
+     * @brief Number of observed pairs
+     *
+     */
+    int observed_count;
+    /**
+     * @brief Last observed pair leading to each cell, -1 if none
+     *
+     */
+    int *predecessors;
+    /**
+     * @brief Previous observed pair leading to the same cell as each pair, -1 if none
+     *
+     */
+    int *links;
+    /**
+     * @brief Binary max-heap of the pairs waiting for a prioritized update, NULL without prioritized sweeping
+     *
+     */
+    int *queue;
+    /**
+     * @brief Number of pairs in the queue
+     *
+     */
+    int queue_count;
+    /**
+     * @brief Index of each pair in the queue, -1 if not queued
+     *
+     */
+    int *positions;
+    /**
+     * @brief Priority of each queued pair, its absolute TD error
+     *
+     */
+    double *priorities;
+} Model;
+
+/**
+ * @brief Structure containing the running reduction of the Q-table updates since the last convergence check
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Maximum absolute change of a Q-value
+     *
+     */
+    double max;
+    /**
+     * @brief Sum of the absolute changes of the Q-values
+     *
+     */
+    double sum;
+    /**
+     * @brief Number of Q-table updates
+     *
+     */
+    long updates;
+    /**
+     * @brief Number of updates that changed the greedy action of their cell
+     *
+     */
+    long changes;
+} Deltas;
+
 /**
  * @brief Structure representing the map
  *
@@ -112,15 +485,40 @@ typedef struct
 typedef struct
 {
     /**
-     * @brief The actual map of shape (height, width)
+     * @brief The actual map of shape (height, width), stored row by row in a contiguous buffer, NULL on a sparse map
+     *
+     */
+    int *map;
+    /**
+     * @brief Cells of a sparse map other than empty ones, used instead of map with a sparse Q-table, NULL on a dense map
+     *
+     */
+    SparseMap *sparse_map;
+    /**
+     * @brief Bitmask of the actions keeping the agent inside the map, for each cell, NULL on a sparse map where they follow from the borders
+     *
+     */
+    unsigned char *actions;
+    /**
+     * @brief Q-table of shape (height, width, action), stored cell by cell in a contiguous buffer, NULL with a sparse Q-table
+     *
+     */
+    QValue *q;
+    /**
+     * @brief Sparse Q-table used instead of q, shared by the copies of the map, NULL if the Q-table is dense
+     *
+     */
+    Sparse *sparse;
+    /**
+     * @brief Memory-mapped file holding the Q-table, NULL if the Q-table is allocated
      *
      */
-    int **map;
+    void *mapping;
     /**
-     * @brief Q-table of shape (height, width, action)
+     * @brief Size of the memory-mapped file
      *
      */
-    double ***q;
+    size_t mapping_size;
     /**
      * @brief Width of the map
      *
@@ -151,15 +549,405 @@ typedef struct
      *
      */
     int epoch;
+    /**
+     * @brief Index of the goals and teleporters of the map
+     *
+     */
+    Landmarks landmarks;
+    /**
+     * @brief Transition table of shape (height, width, action), NULL if not built
+     *
+     */
+    Transition *transitions;
+    /**
+     * @brief Random generator of the agent
+     *
+     */
+    Random random;
+    /**
+     * @brief Q-table updates since the last convergence check, only tracked with a tolerance
+     *
+     */
+    Deltas deltas;
+    /**
+     * @brief Model of the observed transitions for Dyna-Q, its transitions are NULL without planning
+     *
+     */
+    Model model;
+    /**
+     * @brief Replay buffer of the transitions, its size is 0 without experience replay
+     *
+     */
+    Replay replay;
 } Map;
 
+/**
+ * @brief Get the index of a cell in the map and Q-table buffers
+ *
+ * @param map Map containing the cell
+ * @param state Position of the cell
+ * @return int64_t Index of the cell
+ */
+static inline int64_t get_cell(Map map, State state)
+{
+    return (int64_t)state.y * map.width + state.x;
+}
+/**
+ * @brief Get the position of a cell from its index
+ *
+ * @param map Map containing the cell
+ * @param cell Index of the cell
+ * @return State Position of the cell
+ */
+static inline State get_state(Map map, int64_t cell)
+{
+    return (State){cell % map.width, cell / map.width};
+}
+/**
+ * @brief Convert a stored Q-value to a double
+ *
+ * @param value Stored Q-value
+ * @return double Q-value
+ */
+static inline double from_q_value(QValue value)
+{
+#ifdef QTYPE_INT16
+    return (double)value / Q_SCALE;
+#else
+    return value;
+#endif
+}
+/**
+ * @brief Convert a double to a stored Q-value, rounded to the nearest step and saturated with 16-bit Q-values
+ *
+ * @param value Q-value
+ * @return QValue Stored Q-value
+ */
+static inline QValue to_q_value(double value)
+{
+#ifdef QTYPE_INT16
+    value = round(value * Q_SCALE);
+    return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : (QValue)value;
+#else
+    return value;
+#endif
+}
+/**
+ * @brief Allocate an empty sparse Q-table
+ *
+ * @param capacity Initial number of slots, a power of two
+ * @return Sparse* Sparse Q-table, NULL on failure
+ */
+Sparse *allocate_sparse(size_t capacity);
+/**
+ * @brief Add a cell with zero Q-values to a sparse Q-table, doubling its slots when it is 3/4 full
+ *
+ * The process is aborted if the slots cannot grow, since the update of the Q-table cannot be dropped.
+ *
+ * @param sparse Sparse Q-table
+ * @param cell Index of the cell, not stored yet
+ * @return QValue* Q-values of the cell
+ */
+QValue *insert_sparse(Sparse *sparse, int64_t cell);
+/**
+ * @brief Copy a sparse Q-table into another one, reallocating its slots if needed
+ *
+ * @param target Sparse Q-table overwritten
+ * @param source Sparse Q-table copied
+ * @return int Status
+ */
+int copy_sparse(Sparse *target, Sparse *source);
+/**
+ * @brief Get the memory used by a sparse Q-table
+ *
+ * @param sparse Sparse Q-table
+ * @return size_t Size in bytes
+ */
+size_t sparse_memory(Sparse *sparse);
+/**
+ * @brief Free a sparse Q-table
+ *
+ * @param sparse Sparse Q-table, may be NULL
+ */
+void free_sparse(Sparse *sparse);
+/**
+ * @brief Get the first slot probed for a cell in a sparse table, by Fibonacci hashing
+ *
+ * @param cell Index of the cell
+ * @param mask Number of slots minus one
+ * @return size_t Slot
+ */
+static inline size_t hash_cell(int64_t cell, size_t mask)
+{
+    return ((uint64_t)cell * 0x9e3779b97f4a7c15) >> 32 & mask;
+}
+/**
+ * @brief Find the Q-values of a cell in a sparse Q-table, by linear probing from its hash
+ *
+ * @param sparse Sparse Q-table
+ * @param cell Index of the cell
+ * @return QValue* Q-values of the cell, NULL if the cell is not stored
+ */
+static inline QValue *find_sparse(Sparse *sparse, int64_t cell)
+{
+    size_t mask = sparse->capacity - 1;
+    for (size_t slot = hash_cell(cell, mask);; slot = (slot + 1) & mask)
+    {
+        if (sparse->cells[slot] == cell)
+        {
+            return &sparse->values[slot * ACTIONS];
+        }
+        if (sparse->cells[slot] < 0)
+        {
+            return NULL;
+        }
+    }
+}
+/**
+ * @brief Allocate an empty sparse map
+ *
+ * @param capacity Initial number of slots, a power of two
+ * @return SparseMap* Sparse map, NULL on failure
+ */
+SparseMap *allocate_sparse_map(size_t capacity);
+/**
+ * @brief Set the type of a cell of a sparse map, doubling its slots when it is 3/4 full
+ *
+ * @param sparse_map Sparse map
+ * @param cell Index of the cell
+ * @param type Type of the cell
+ * @return int Status
+ */
+int insert_sparse_map(SparseMap *sparse_map, int64_t cell, enum Type type);
+/**
+ * @brief Get the memory used by a sparse map
+ *
+ * @param sparse_map Sparse map
+ * @return size_t Size in bytes
+ */
+size_t sparse_map_memory(SparseMap *sparse_map);
+/**
+ * @brief Free a sparse map
+ *
+ * @param sparse_map Sparse map, may be NULL
+ */
+void free_sparse_map(SparseMap *sparse_map);
+/**
+ * @brief Find the type of a cell in a sparse map, by linear probing from its hash
+ *
+ * It is not inlined, so that get_type() stays small enough to be inlined on dense maps.
+ *
+ * @param sparse_map Sparse map
+ * @param cell Index of the cell
+ * @return enum Type Type of the cell, EMPTY if the cell is not stored
+ */
+enum Type find_sparse_map(SparseMap *sparse_map, int64_t cell);
+/**
+ * @brief Get the type of a cell from its index, in the map buffer or the sparse map
+ *
+ * @param map Map containing the cell
+ * @param cell Index of the cell
+ * @return enum Type Type of the cell
+ */
+static inline enum Type get_cell_type(Map map, int64_t cell)
+{
+    return map.map != NULL ? map.map[cell] : find_sparse_map(map.sparse_map, cell);
+}
+/**
+ * @brief Get the bitmask of the actions keeping the agent inside the map from a cell
+ *
+ * @param map Map containing the cell
+ * @param cell Index of the cell
+ * @return int Bitmask of the possible actions
+ */
+static inline int get_actions(Map map, int64_t cell)
+{
+    if (map.actions != NULL)
+    {
+        return map.actions[cell];
+    }
+    State state = get_state(map, cell);
+    return (state.y > 0) << UP | (state.y < map.height - 1) << DOWN | (state.x > 0) << LEFT | (state.x < map.width - 1) << RIGHT;
+}
+/**
+ * @brief Check if the cells of a map can be indexed by int, as in the transition table, the policy, the evaluator and the GUI
+ *
+ * @param map Map to check
+ * @return int Status
+ */
+static inline int check_cells(Map map)
+{
+    return (int64_t)map.width * map.height <= INT_MAX;
+}
+/**
+ * @brief Get a Q-value of a cell, with a relaxed atomic load so that threads can share the Q-table
+ *
+ * @param map Map containing the Q-table
+ * @param cell Index of the cell
+ * @param action Action of the Q-value
+ * @return double Q-value, 0 for the cells missing from a sparse Q-table
+ */
+static inline double get_q(Map map, int64_t cell, enum Action action)
+{
+    QValue value;
+    if (map.sparse != NULL)
+    {
+        QValue *values = find_sparse(map.sparse, cell);
+        return values != NULL ? from_q_value(values[action]) : 0;
+    }
+    __atomic_load(&map.q[(size_t)cell * ACTIONS + action], &value, __ATOMIC_RELAXED);
+    return from_q_value(value);
+}
+/**
+ * @brief Set a Q-value of a cell, with a relaxed atomic store so that threads can share the Q-table
+ *
+ * A cell missing from a sparse Q-table is only added once one of its Q-values is not 0.
+ *
+ * @param map Map containing the Q-table
+ * @param cell Index of the cell
+ * @param action Action of the Q-value
+ * @param value New Q-value
+ */
+static inline void set_q(Map map, int64_t cell, enum Action action, double value)
+{
+    QValue stored = to_q_value(value);
+    if (map.sparse != NULL)
+    {
+        QValue *values = find_sparse(map.sparse, cell);
+        if (values == NULL && stored != 0)
+        {
+            values = insert_sparse(map.sparse, cell);
+        }
+        if (values != NULL)
+        {
+            values[action] = stored;
+        }
+        return;
+    }
+    __atomic_store(&map.q[(size_t)cell * ACTIONS + action], &stored, __ATOMIC_RELAXED);
+}
+/**
+ * @brief Find the maximum Q-value of a cell, like max_q() without going through a state
+ *
+ * @param map Map containing the Q-table
+ * @param cell Index of the cell
+ * @return double Maximum Q-value
+ */
+static inline double max_q_cell(Map map, int64_t cell)
+{
+    double best = get_q(map, cell, UP);
+    for (int i = 1; i < ACTIONS; i++)
+    {
+        double value = get_q(map, cell, i);
+        if (value > best)
+        {
+            best = value;
+        }
+    }
+    return best;
+}
+/**
+ * @brief Add a Q-table update to the running reduction of the updates
+ *
+ * The greedy action changes when the updated action crosses the best other action of the cell,
+ * with the tolerance as margin so that near ties do not flip forever.
+ *
+ * @param deltas Running reduction
+ * @param map Map containing the Q-table, after the update
+ * @param cell Index of the cell
+ * @param actions Bitmask of the possible actions of the cell
+ * @param action Updated action
+ * @param old Q-value before the update
+ * @param tolerance Tolerance of the convergence
+ */
+static inline void track_update(Deltas *deltas, Map map, int64_t cell, int actions, enum Action action, double old, double tolerance)
+{
+    double value = get_q(map, cell, action);
+    double delta = fabs(value - old);
+    deltas->max = delta > deltas->max ? delta : deltas->max;
+    deltas->sum += delta;
+    deltas->updates++;
+
+    double other = -INFINITY;
+    for (int i = 0; i < ACTIONS; i++)
+    {
+        if (i != (int)action && actions & 1 << i && get_q(map, cell, i) > other)
+        {
+            other = get_q(map, cell, i);
+        }
+    }
+    deltas->changes += (old >= other - tolerance) != (value >= other - tolerance);
+}
+
+/**
+ * @brief Pick uniformly one of the actions of a bitmask
+ *
+ * @param random Random generator
+ * @param actions Bitmask of the actions to choose from
+ * @return enum Action Picked action, UP if the bitmask is empty
+ */
+static inline enum Action pick_action(Random *random, int actions)
+{
+    int count = __builtin_popcount(actions);
+    if (count <= 1)
+    {
+        return actions ? __builtin_ctz(actions) : UP;
+    }
+    // drop the lowest actions until the picked one is the lowest left
+    for (int i = random_int(random, count); i > 0; i--)
+    {
+        actions &= actions - 1;
+    }
+    return __builtin_ctz(actions);
+}
+
+/**
+ * @brief Allocate a zeroed buffer aligned on ALIGNMENT bytes, freed with free()
+ *
+ * @param size Size of the buffer in bytes
+ * @return void* Allocated buffer, NULL on failure
+ */
+void *allocate_aligned(size_t size);
+/**
+ * @brief Allocate an empty map structure with zeroed map and Q-table buffers
+ *
+ * @param width Width of the map
+ * @param height Height of the map
+ * @param sparse Store the map and the Q-table in a sparse map and a sparse Q-table instead of dense buffers
+ * @return Map Allocated map, with NULL buffers on failure
+ */
+Map allocate_map(int width, int height, int sparse);
 /**
  * @brief Initialize the map structure and build the map
  *
+ * @param map Map to initialize with the default map
+ * @param teleporter Enable teleporter
+ * @param sparse Store the map and the Q-table in a sparse map and a sparse Q-table
+ * @return int Status
+ */
+int build_map(Map *map, int teleporter, int sparse);
+/**
+ * @brief Build the possible actions and the landmark index of the map, pairing the n-th teleporter 1 with the n-th teleporter 2 in reading order
+ *
+ * @param map Map to index
+ * @return int Status
+ */
+int index_map(Map *map);
+/**
+ * @brief Load a map from a file
+ *
+ * The file starts with the width and the height of the map, followed by one character per cell, row by row:
+ * '.' empty, '#' wall, 'G' goal 1, 'g' goal 2, 'T' teleporter 1, 't' teleporter 2 and 'S' starting position.
+ * Whitespaces and line breaks between cells are ignored.
+ * The cells can also be listed as "x y c" lines, c being the character of the cell at column x and row y, the cells not listed being empty.
+ *
+ * @param map Map to initialize with the loaded map
+ * @param filename Name of the file containing the map
  * @param teleporter Enable teleporter
- * @return Map Initialized map
+ * @param sparse Store the map and the Q-table in a sparse map and a sparse Q-table
+ * @return int Status
  */
-Map build_map(int teleporter);
+int load_map(Map *map, char *filename, int teleporter, int sparse);
 /**
  * @brief Free the map structure
  *
@@ -190,6 +978,14 @@ int are_states_equal(State state1, State state2);
  * @return State Position of the cell
  */
 State find_state(Map map, enum Type type);
+/**
+ * @brief Find the exit of the teleporter at a position
+ *
+ * @param map Map containing the teleporter
+ * @param state Position of the teleporter 1 cell
+ * @return State Position of the paired teleporter 2 cell, or the same position if there is none
+ */
+State find_exit(Map map, State state);
 /**
  * @brief Get the type of a cell
  *
@@ -203,9 +999,31 @@ enum Type get_type(Map map, State state);
  *
  * @param map Map to look in
  * @param state State to find the maximum Q-value
- * @return int Maximum Q-value
+ * @return double Maximum Q-value
+ */
+double max_q(Map map, State state);
+/**
+ * @brief Allocate the model of the observed transitions for Dyna-Q planning
+ *
+ * @param map Map to plan on
+ * @param prioritized Allocate the queue of prioritized sweeping
+ * @return int 1 if success, 0 otherwise
  */
-int max_q(Map map, State state);
+int init_model(Map *map, int prioritized);
+/**
+ * @brief Record a real transition in the model and run the planning updates of Dyna-Q
+ *
+ * Planning replays observed transitions with the update of q(), drawn uniformly,
+ * or, with prioritized sweeping, the ones with the largest TD error above theta with full backups, queueing the predecessors of each updated cell.
+ *
+ * @param map Map containing the Q-table and the model
+ * @param cell Index of the cell of the transition
+ * @param action Action of the transition
+ * @param reward Reward of the transition
+ * @param next Index of the cell reached
+ * @param params Parameters, with the number of planning updates
+ */
+void plan(Map *map, int cell, enum Action action, int reward, int next, Params params);
 /**
  * @brief Calculate the euclidean distance between two states
  *
@@ -215,7 +1033,67 @@ int max_q(Map map, State state);
  */
 double euclidean_distance(State state1, State state2);
 /**
- * @brief Q-learning algorithm
+ * @brief Calculate the reward of a move
+ *
+ * @param map Map containing the move
+ * @param state State before the move
+ * @param next_state State after the move and teleportation
+ * @param type Type of the cell moved to, before teleportation
+ * @param params Parameters
+ * @return int Reward
+ */
+int get_reward(Map map, State state, State next_state, enum Type type, Params params);
+/**
+ * @brief Precompute the next state, reward and terminal flag of every action in every cell
+ *
+ * @param map Map to build the transition table of
+ * @param params Parameters of the reward system
+ * @return int Status
+ */
+int build_transitions(Map *map, Params params);
+/**
+ * @brief Choose the action of the agent, greedy with random ties, and epsilon-greedy in training mode
+ *
+ * @param map Map containing the Q-table and the random generator
+ * @param cell Index of the cell of the agent
+ * @param params Parameters
+ * @return enum Action Chosen action
+ */
+enum Action choose_action(Map *map, int64_t cell, Params params);
+/**
+ * @brief Apply an action to the environment, through the transition table if present
+ *
+ * @param map Map to use
+ * @param state Current state
+ * @param action Action of the agent
+ * @param params Parameters
+ * @param reward Reward of the move, not computed in test mode
+ * @return State Next state, a wall if the agent bumped into one
+ */
+State step_state(Map *map, State state, enum Action action, Params params, int *reward);
+/**
+ * @brief Update the Q-value of a transition and run the Dyna-Q planning updates if enabled
+ *
+ * @param map Map containing the Q-table
+ * @param cell Index of the cell of the transition
+ * @param action Action of the transition
+ * @param reward Reward of the transition
+ * @param next Index of the cell reached
+ * @param params Parameters
+ */
+void update_q(Map *map, int64_t cell, enum Action action, int reward, int64_t next, Params params);
+/**
+ * @brief Update the Q-table with a minibatch sampled from the replay buffer
+ *
+ * The TD targets of the whole minibatch are computed first, then the Q-values are updated in minibatch order,
+ * so both loops run over contiguous arrays.
+ *
+ * @param map Map containing the Q-table and the replay buffer
+ * @param params Parameters
+ */
+void learn_replay(Map *map, Params params);
+/**
+ * @brief Q-learning algorithm, one step of the agent and its update, or its transition appended to the replay buffer
  *
  * @param map Map to use
  * @param state Current state
@@ -242,14 +1120,32 @@ int check_action(Map map, enum Action action);
 /**
  * @brief Epislon-greedy policy
  *
- * @param map Map containing the agent
+ * @param random Random generator
  * @param action Intended action
+ * @param actions Bitmask of the possible actions
  * @param epsilon Epsilon value
  * @return enum Action Final action
  */
-enum Action epsilon_greedy(Map map, enum Action action, float epsilon);
+enum Action epsilon_greedy(Random *random, enum Action action, int actions, float epsilon);
+/**
+ * @brief Calculate the checksum of a Q-table (64-bit FNV-1a over its words)
+ *
+ * @param q Q-values
+ * @param size Size of the Q-values in bytes
+ * @return uint64_t Checksum
+ */
+uint64_t checksum_q(const void *q, size_t size);
 /**
- * @brief Load a Q-table from a file
+ * @brief Check if a file name has the binary Q-table extension
+ *
+ * @param filename Name of the file
+ * @return int Status
+ */
+int is_binary(char *filename);
+/**
+ * @brief Load a Q-table from a file, in text or binary format
+ *
+ * Binary files are checked against the map and memory-mapped, then used directly as the Q-table.
  *
  * @param map Map to store the loaded Q-table
  * @param filename Name of the file containing the Q-table
@@ -257,12 +1153,20 @@ enum Action epsilon_greedy(Map map, enum Action action, float epsilon);
  */
 int load_q(Map *map, char *filename);
 /**
- * @brief Save the Q-table to a file
+ * @brief Save the Q-table to a file, in binary format if its name ends with Q_EXTENSION, in text format otherwise
  *
  * @param map Map containing the Q-table to save
  * @param filename Name of the file to save the Q-table
  * @return int Status
  */
 int save_q(Map map, char *filename);
+/**
+ * @brief Get the length of the greedy path from the start to a goal
+ *
+ * @param map Map containing the Q-table
+ * @param params Parameters
+ * @return int Number of steps, -1 if no goal is reached within one step per cell
+ */
+int greedy_path(Map map, Params params);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,48 @@
+/**
+ * @file random.c
+ * @author Antoine Qiu
+ * @brief Implementation of the pseudo-random number generator (xoshiro256**)
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "random.h"
+
+void seed_random(Random *random, uint64_t seed)
+{
+    // splitmix64 spreads the seed over the whole state, which can never be all zero
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        random->s[i] = z ^ (z >> 31);
+    }
+}
+
+void jump_random(Random *random)
+{
+    static const uint64_t jump[] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+
+    uint64_t s[4] = {0};
+    for (int i = 0; i < 4; i++)
+    {
+        for (int b = 0; b < 64; b++)
+        {
+            if (jump[i] & ((uint64_t)1 << b))
+            {
+                for (int j = 0; j < 4; j++)
+                {
+                    s[j] ^= random->s[j];
+                }
+            }
+            next_random(random);
+        }
+    }
+    for (int j = 0; j < 4; j++)
+    {
+        random->s[j] = s[j];
+    }
+}
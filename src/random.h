@@ -0,0 +1,95 @@
+/**
+ * @file random.h
+ * @author Antoine Qiu
+ * @brief Definition of the pseudo-random number generator (xoshiro256**)
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+/**
+ * @brief State of a pseudo-random number generator, each context owns its own
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Internal state, never all zero
+     *
+     */
+    uint64_t s[4];
+} Random;
+
+/**
+ * @brief Rotate a 64-bit value to the left
+ *
+ * @param x Value to rotate
+ * @param k Number of bits
+ * @return uint64_t Rotated value
+ */
+static inline uint64_t rotate_left(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+/**
+ * @brief Generate the next 64-bit random value
+ *
+ * @param random Generator to advance
+ * @return uint64_t Random value
+ */
+static inline uint64_t next_random(Random *random)
+{
+    uint64_t *s = random->s;
+    uint64_t result = rotate_left(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotate_left(s[3], 45);
+    return result;
+}
+/**
+ * @brief Generate a random integer in [0, n)
+ *
+ * @param random Generator to advance
+ * @param n Upper bound, at most 2^32
+ * @return int Random integer
+ */
+static inline int random_int(Random *random, int n)
+{
+    return ((next_random(random) >> 32) * (uint64_t)n) >> 32;
+}
+/**
+ * @brief Generate a random float in [0, 1)
+ *
+ * @param random Generator to advance
+ * @return float Random float
+ */
+static inline float random_float(Random *random)
+{
+    return (next_random(random) >> 40) * 0x1.0p-24f;
+}
+
+/**
+ * @brief Seed a generator, the same seed always gives the same sequence
+ *
+ * @param random Generator to seed
+ * @param seed Seed
+ */
+void seed_random(Random *random, uint64_t seed);
+/**
+ * @brief Advance a generator by 2^128 values, giving a stream independent of the previous one
+ *
+ * @param random Generator to advance
+ */
+void jump_random(Random *random);
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * @file replay.c
+ * @author Antoine Qiu
+ * @brief Implementation of the experience replay ring buffer
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "replay.h"
+
+int init_replay(Replay *replay, int size, int batch, int prioritized)
+{
+    *replay = (Replay){0};
+    replay->size = size;
+    replay->batch = batch;
+    replay->cells = malloc(size * sizeof(int64_t));
+    replay->actions = malloc(size);
+    replay->rewards = malloc(size * sizeof(int));
+    replay->next = malloc(size * sizeof(int64_t));
+    replay->samples = malloc(batch * sizeof(int));
+    replay->weights = malloc(batch * sizeof(double));
+    replay->targets = malloc(batch * sizeof(double));
+    int status = replay->cells != NULL && replay->actions != NULL && replay->rewards != NULL && replay->next != NULL &&
+                 replay->samples != NULL && replay->weights != NULL && replay->targets != NULL;
+
+    // the sum tree is stored as a heap, node i has children 2i and 2i + 1 and the root is node 1
+    if (prioritized)
+    {
+        replay->leaves = 1;
+        while (replay->leaves < size)
+        {
+            replay->leaves *= 2;
+        }
+        replay->tree = calloc(2 * replay->leaves, sizeof(double));
+        replay->max_priority = 1;
+        status = status && replay->tree != NULL;
+    }
+    for (int i = 0; status && i < batch; i++)
+    {
+        replay->weights[i] = 1;
+    }
+    return status;
+}
+
+void free_replay(Replay replay)
+{
+    free(replay.cells);
+    free(replay.actions);
+    free(replay.rewards);
+    free(replay.next);
+    free(replay.samples);
+    free(replay.weights);
+    free(replay.targets);
+    free(replay.tree);
+}
+
+/**
+ * @brief Set a leaf of the sum tree and update its ancestors
+ *
+ * @param replay Replay buffer
+ * @param index Index of the transition
+ * @param priority Priority of the transition
+ */
+static void set_leaf(Replay *replay, int index, double priority)
+{
+    // parents are summed again rather than shifted by the change, so that rounding errors do not pile up
+    int node = replay->leaves + index;
+    replay->tree[node] = priority;
+    for (node /= 2; node >= 1; node /= 2)
+    {
+        replay->tree[node] = replay->tree[2 * node] + replay->tree[2 * node + 1];
+    }
+}
+
+void push_replay(Replay *replay, int64_t cell, int action, int reward, int64_t next)
+{
+    int i = replay->head;
+    replay->cells[i] = cell;
+    replay->actions[i] = action;
+    replay->rewards[i] = reward;
+    replay->next[i] = next;
+    if (replay->tree != NULL)
+    {
+        set_leaf(replay, i, replay->max_priority);
+    }
+    replay->head = (i + 1) % replay->size;
+    replay->count += replay->count < replay->size;
+    replay->pending++;
+}
+
+void sample_replay(Replay *replay, Random *random)
+{
+    if (replay->tree == NULL)
+    {
+        for (int k = 0; k < replay->batch; k++)
+        {
+            replay->samples[k] = random_int(random, replay->count);
+        }
+        return;
+    }
+
+    // one draw in each of batch equal slices of the total priority, then down the tree to the leaf covering it
+    double total = replay->tree[1];
+    double slice = total / replay->batch;
+    double max_weight = 0;
+    for (int k = 0; k < replay->batch; k++)
+    {
+        double value = (k + random_float(random)) * slice;
+        int node = 1;
+        while (node < replay->leaves)
+        {
+            node *= 2;
+            if (value >= replay->tree[node] && replay->tree[node + 1] > 0)
+            {
+                value -= replay->tree[node];
+                node++;
+            }
+        }
+        replay->samples[k] = node - replay->leaves;
+
+        // importance sampling weights undo the bias of prioritized sampling, scaled so that the largest is 1
+        double probability = replay->tree[node] / total;
+        replay->weights[k] = probability > 0 ? pow(replay->count * probability, -IMPORTANCE_EXPONENT) : 0;
+        max_weight = replay->weights[k] > max_weight ? replay->weights[k] : max_weight;
+    }
+    for (int k = 0; k < replay->batch && max_weight > 0; k++)
+    {
+        replay->weights[k] /= max_weight;
+    }
+}
+
+void set_priority(Replay *replay, int index, double error)
+{
+    double priority = pow(fabs(error) + PRIORITY_EPSILON, PRIORITY_EXPONENT);
+    replay->max_priority = priority > replay->max_priority ? priority : replay->max_priority;
+    set_leaf(replay, index, priority);
+}
@@ -0,0 +1,164 @@
+/**
+ * @file replay.h
+ * @author Antoine Qiu
+ * @brief Definition of the experience replay ring buffer
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "random.h"
+
+/**
+ * @brief Exponent applied to the TD errors to get the priorities of prioritized sampling
+ *
+ */
+#define PRIORITY_EXPONENT 0.6
+/**
+ * @brief Exponent of the importance sampling weights correcting prioritized sampling
+ *
+ */
+#define IMPORTANCE_EXPONENT 0.4
+/**
+ * @brief Added to the TD errors so that every transition keeps a chance to be sampled
+ *
+ */
+#define PRIORITY_EPSILON 0.01
+
+/**
+ * @brief Structure representing a ring buffer of transitions, stored as separate arrays
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Maximum number of transitions, 0 without replay
+     *
+     */
+    int size;
+    /**
+     * @brief Number of transitions stored
+     *
+     */
+    int count;
+    /**
+     * @brief Index of the next transition written, the oldest one once the buffer is full
+     *
+     */
+    int head;
+    /**
+     * @brief Number of transitions sampled by an update
+     *
+     */
+    int batch;
+    /**
+     * @brief Number of transitions appended since the last update
+     *
+     */
+    int pending;
+    /**
+     * @brief Cell of each transition
+     *
+     */
+    int64_t *cells;
+    /**
+     * @brief Action of each transition
+     *
+     */
+    unsigned char *actions;
+    /**
+     * @brief Reward of each transition
+     *
+     */
+    int *rewards;
+    /**
+     * @brief Cell reached by each transition
+     *
+     */
+    int64_t *next;
+    /**
+     * @brief Transitions of the current minibatch
+     *
+     */
+    int *samples;
+    /**
+     * @brief Learning rate scale of each transition of the current minibatch, 1 with uniform sampling
+     *
+     */
+    double *weights;
+    /**
+     * @brief TD targets of the current minibatch
+     *
+     */
+    double *targets;
+    /**
+     * @brief Sum tree of the priorities with the leaves from index leaves, NULL with uniform sampling
+     *
+     */
+    double *tree;
+    /**
+     * @brief Number of leaves of the sum tree, a power of two
+     *
+     */
+    int leaves;
+    /**
+     * @brief Largest priority given so far, given to new transitions so that they are sampled soon
+     *
+     */
+    double max_priority;
+} Replay;
+
+/**
+ * @brief Allocate a replay buffer
+ *
+ * @param replay Replay buffer
+ * @param size Maximum number of transitions
+ * @param batch Number of transitions sampled by an update
+ * @param prioritized Sample the transitions proportionally to their TD error instead of uniformly
+ * @return int 1 if success, 0 otherwise
+ */
+int init_replay(Replay *replay, int size, int batch, int prioritized);
+
+/**
+ * @brief Free a replay buffer
+ *
+ * @param replay Replay buffer
+ */
+void free_replay(Replay replay);
+
+/**
+ * @brief Append a transition, overwriting the oldest one when the buffer is full
+ *
+ * @param replay Replay buffer
+ * @param cell Cell of the transition
+ * @param action Action of the transition
+ * @param reward Reward of the transition
+ * @param next Cell reached
+ */
+void push_replay(Replay *replay, int64_t cell, int action, int reward, int64_t next);
+
+/**
+ * @brief Draw a minibatch of transitions into samples, with their weights
+ *
+ * @param replay Replay buffer, not empty
+ * @param random Random generator
+ */
+void sample_replay(Replay *replay, Random *random);
+
+/**
+ * @brief Set the priority of a sampled transition from its TD error
+ *
+ * @param replay Replay buffer
+ * @param index Index of the transition
+ * @param error TD error of the transition
+ */
+void set_priority(Replay *replay, int index, double error);
+
+#endif
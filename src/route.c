@@ -0,0 +1,128 @@
+/**
+ * @file route.c
+ * @author Antoine Qiu
+ * @brief Implementation of the route of waypoints followed in loop mode
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "route.h"
+
+/**
+ * @brief Q-tables of the default route, leading to goal 1, goal 2 and starting point
+ *
+ */
+static char *default_files[] = {"./loop/goal_1.txt", "./loop/goal_2.txt", "./loop/start.txt"};
+
+int init_route(Route *route, Map *map, Params params)
+{
+    *route = (Route){0};
+    route->own = *map;
+    int count = params.waypoints_count > 0 ? params.waypoints_count : 3;
+    route->states = malloc(count * sizeof(State));
+    route->tables = calloc(count, sizeof(Map));
+    if (route->states == NULL || route->tables == NULL)
+    {
+        printf("Failed to allocate route\n");
+        free_route(route, map);
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        State state;
+        char *file;
+        if (params.waypoints_count > 0)
+        {
+            state = (State){params.waypoints[i].x, params.waypoints[i].y};
+            file = params.waypoints[i].file;
+        }
+        else
+        {
+            state = i == 0 ? find_state(*map, GOAL_1) : i == 1 ? find_state(*map, GOAL_2) : (*map).start;
+            file = default_files[i];
+        }
+        if (!check_state(*map, state) || get_type(*map, state) == WALL)
+        {
+            printf("Waypoint %d at (%d, %d) is not a free cell of the map\n", i + 1, state.x, state.y);
+            free_route(route, map);
+            return 0;
+        }
+        route->states[i] = state;
+
+        // each table shares the map buffers but owns its Q-values, loaded once here
+        Map *table = &route->tables[i];
+        *table = *map;
+        table->q = NULL;
+        table->sparse = NULL;
+        table->mapping = NULL;
+        table->mapping_size = 0;
+        route->count = i + 1;
+        if ((*map).sparse != NULL)
+        {
+            table->sparse = allocate_sparse(SPARSE_CAPACITY);
+        }
+        else
+        {
+            table->q = allocate_aligned((size_t)(*map).width * (*map).height * ACTIONS * sizeof(QValue));
+        }
+        if ((table->q == NULL && table->sparse == NULL) || !load_q(table, file))
+        {
+            printf("Failed to load Q-table from %s\n", file);
+            free_route(route, map);
+            return 0;
+        }
+    }
+
+    select_waypoint(route, map, 0);
+    return 1;
+}
+
+void select_waypoint(Route *route, Map *map, int waypoint)
+{
+    Map *table = &route->tables[waypoint];
+    route->current = waypoint;
+    (*map).q = table->q;
+    (*map).sparse = table->sparse;
+    (*map).mapping = table->mapping;
+    (*map).mapping_size = table->mapping_size;
+}
+
+int advance_route(Route *route, Map *map)
+{
+    if (!are_states_equal((*map).agent, route->states[route->current]))
+    {
+        return 0;
+    }
+    int next = (route->current + 1) % route->count;
+    select_waypoint(route, map, next);
+    return next == 0;
+}
+
+void free_route(Route *route, Map *map)
+{
+    for (int i = 0; i < route->count; i++)
+    {
+        Map table = route->tables[i];
+        if (table.mapping != NULL)
+        {
+            munmap(table.mapping, table.mapping_size);
+        }
+        else
+        {
+            free(table.q);
+        }
+        free_sparse(table.sparse);
+    }
+    free(route->states);
+    free(route->tables);
+
+    // the map frees its own Q-table
+    (*map).q = route->own.q;
+    (*map).sparse = route->own.sparse;
+    (*map).mapping = route->own.mapping;
+    (*map).mapping_size = route->own.mapping_size;
+    *route = (Route){0};
+}
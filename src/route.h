@@ -0,0 +1,87 @@
+/**
+ * @file route.h
+ * @author Antoine Qiu
+ * @brief Definition of the route of waypoints followed in loop mode
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include <stdio.h>
+#include "q_learning.h"
+#include "params.h"
+
+/**
+ * @brief Structure representing a route of waypoints, each with the Q-table leading to it, all loaded in memory
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Number of waypoints
+     *
+     */
+    int count;
+    /**
+     * @brief Waypoint the agent is heading to
+     *
+     */
+    int current;
+    /**
+     * @brief Position of each waypoint, the last one ending a loop
+     *
+     */
+    State *states;
+    /**
+     * @brief Q-table leading to each waypoint, in the order of states, held by copies of the trained map sharing its other buffers and owning only their Q-values
+     *
+     */
+    Map *tables;
+    /**
+     * @brief Map holding the Q-table of the trained map, given back to it when the route is freed
+     *
+     */
+    Map own;
+} Route;
+
+/**
+ * @brief Load the Q-table of every waypoint and start the route at the first one
+ *
+ * @param route Route to initialize
+ * @param map Map trained, whose Q-table is replaced by the one of the first waypoint
+ * @param params Parameters, with the waypoints or none for goal 1, goal 2 and starting point
+ * @return int 1 if success, 0 otherwise
+ */
+int init_route(Route *route, Map *map, Params params);
+
+/**
+ * @brief Switch to the Q-table of a waypoint, without copying it
+ *
+ * @param route Route
+ * @param map Map trained
+ * @param waypoint Waypoint the agent heads to
+ */
+void select_waypoint(Route *route, Map *map, int waypoint);
+
+/**
+ * @brief Switch to the next waypoint if the agent reached the current one
+ *
+ * @param route Route
+ * @param map Map trained
+ * @return int 1 if the agent reached the last waypoint, and heads to the first one again
+ */
+int advance_route(Route *route, Map *map);
+
+/**
+ * @brief Free the Q-tables of the waypoints and give the map its own Q-table back
+ *
+ * @param route Route
+ * @param map Map trained
+ */
+void free_route(Route *route, Map *map);
+
+#endif
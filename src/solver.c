@@ -0,0 +1,205 @@
+/**
+ * @file solver.c
+ * @author Antoine Qiu
+ * @brief Implementation of the value iteration solver
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "solver.h"
+
+/**
+ * @brief Update the Q-values of the cells of a tile
+ *
+ * @param map Map containing the transition table
+ * @param params Parameters
+ * @param source Q-table read
+ * @param target Q-table written, the same as source for Gauss-Seidel sweeps
+ * @param tile Index of the tile, row by row
+ * @return double Maximum change of a Q-value
+ */
+static double sweep_tile(Map map, Params params, QValue *source, QValue *target, int tile)
+{
+    int tiles_x = (map.width + TILE - 1) / TILE;
+    int x0 = tile % tiles_x * TILE;
+    int y0 = tile / tiles_x * TILE;
+    int x1 = x0 + TILE < map.width ? x0 + TILE : map.width;
+    int y1 = y0 + TILE < map.height ? y0 + TILE : map.height;
+    Map read = map;
+    read.q = source;
+    Map write = map;
+    write.q = target;
+    double delta = 0;
+
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            // the agent never stands on walls, goals or teleporter entrances, their Q-values are never updated
+            int cell = y * map.width + x;
+            enum Type type = map.map[cell];
+            if (type == WALL || type == GOAL_1 || type == GOAL_2 || (params.teleporter && type == TELEPORTER_1))
+            {
+                continue;
+            }
+            int actions = map.actions[cell];
+            for (int action = 0; action < ACTIONS; action++)
+            {
+                if (!(actions & 1 << action))
+                {
+                    continue;
+                }
+                Transition transition = map.transitions[(size_t)cell * ACTIONS + action];
+                double old = get_q(read, cell, action);
+                double value = transition.reward + params.gamma * max_q_cell(read, transition.next);
+                // the change is measured on the stored value, rounding to the Q-value type would otherwise never settle
+                set_q(write, cell, action, value);
+                value = get_q(write, cell, action);
+                delta = fabs(value - old) > delta ? fabs(value - old) : delta;
+            }
+        }
+    }
+    return delta;
+}
+
+void *run_sweeper(void *arg)
+{
+    Sweeper *sweeper = arg;
+    int tiles = ((sweeper->map.width + TILE - 1) / TILE) * ((sweeper->map.height + TILE - 1) / TILE);
+    pthread_mutex_lock(sweeper->gate);
+    pthread_mutex_unlock(sweeper->gate);
+    if (*sweeper->done)
+    {
+        return NULL;
+    }
+    while (1)
+    {
+        pthread_barrier_wait(sweeper->barrier);
+        if (*sweeper->done)
+        {
+            break;
+        }
+        sweeper->delta = 0;
+        for (int tile = __atomic_fetch_add(sweeper->next, 1, __ATOMIC_RELAXED); tile < tiles; tile = __atomic_fetch_add(sweeper->next, 1, __ATOMIC_RELAXED))
+        {
+            double delta = sweep_tile(sweeper->map, sweeper->params, *sweeper->source, *sweeper->target, tile);
+            sweeper->delta = delta > sweeper->delta ? delta : sweeper->delta;
+        }
+        pthread_barrier_wait(sweeper->barrier);
+    }
+    return NULL;
+}
+
+int solve_q(Map *map, Params params)
+{
+    if ((*map).transitions == NULL && !build_transitions(map, params))
+    {
+        return 0;
+    }
+
+    // synchronous sweeps read the previous Q-table and write the other one
+    size_t size = (size_t)(*map).width * (*map).height * ACTIONS * sizeof(QValue);
+    QValue *source = (*map).q;
+    QValue *target = (*map).q;
+    if (!params.gauss_seidel)
+    {
+        target = malloc(size);
+        if (target == NULL)
+        {
+            return 0;
+        }
+        memcpy(target, source, size);
+    }
+
+    int next = 0;
+    int done = 0;
+    pthread_mutex_t gate = PTHREAD_MUTEX_INITIALIZER;
+    pthread_barrier_t barrier;
+    Sweeper *sweepers = malloc(params.threads * sizeof(Sweeper));
+    pthread_t *threads = malloc(params.threads * sizeof(pthread_t));
+    if (sweepers == NULL || threads == NULL || pthread_barrier_init(&barrier, NULL, params.threads + 1) != 0)
+    {
+        free(sweepers);
+        free(threads);
+        if (target != (*map).q)
+        {
+            free(target);
+        }
+        return 0;
+    }
+    int started = 0;
+    pthread_mutex_lock(&gate);
+    for (; started < params.threads; started++)
+    {
+        sweepers[started] = (Sweeper){*map, params, &source, &target, &next, &done, &gate, &barrier, 0};
+        if (pthread_create(&threads[started], NULL, run_sweeper, &sweepers[started]) != 0)
+        {
+            break;
+        }
+    }
+    done = started < params.threads;
+    pthread_mutex_unlock(&gate);
+
+    struct timeval start, now;
+    gettimeofday(&start, NULL);
+    int sweeps = 0;
+    double delta = 0;
+    while (!done && (params.epochs < 0 || sweeps < params.epochs))
+    {
+        next = 0;
+        pthread_barrier_wait(&barrier);
+        pthread_barrier_wait(&barrier);
+        sweeps++;
+
+        delta = 0;
+        for (int i = 0; i < params.threads; i++)
+        {
+            delta = sweepers[i].delta > delta ? sweepers[i].delta : delta;
+        }
+        if (!params.gauss_seidel)
+        {
+            QValue *swap = source;
+            source = target;
+            target = swap;
+        }
+        if (delta <= params.tolerance)
+        {
+            break;
+        }
+    }
+
+    // the threads waiting for the next sweep are released to stop
+    if (!done)
+    {
+        done = 1;
+        pthread_barrier_wait(&barrier);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&barrier);
+    gettimeofday(&now, NULL);
+    double time = (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1e6;
+
+    // the last sweep wrote the buffer now in source
+    if (source != (*map).q)
+    {
+        memcpy((*map).q, source, size);
+        free(source);
+    }
+    else if (target != (*map).q)
+    {
+        free(target);
+    }
+
+    if (params.print && started == params.threads)
+    {
+        printf("Value iteration (%s, %d threads)\t%d sweeps\tmax dQ %g\t%.3f s\n", params.gauss_seidel ? "Gauss-Seidel" : "synchronous", params.threads, sweeps, delta, time);
+    }
+    free(sweepers);
+    free(threads);
+    return started == params.threads;
+}
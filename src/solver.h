@@ -0,0 +1,100 @@
+/**
+ * @file solver.h
+ * @author Antoine Qiu
+ * @brief Definition of the value iteration solver
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "q_learning.h"
+#include "params.h"
+
+/**
+ * @brief Width and height of the square tiles of cells swept together
+ *
+ */
+#define TILE 64
+
+/**
+ * @brief Structure representing a sweeping thread, shared state is behind pointers
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Map containing the transition table
+     *
+     */
+    Map map;
+    /**
+     * @brief Parameters
+     *
+     */
+    Params params;
+    /**
+     * @brief Q-table read by the sweep, points to the Q-table read and written with Gauss-Seidel sweeps
+     *
+     */
+    QValue **source;
+    /**
+     * @brief Q-table written by the sweep
+     *
+     */
+    QValue **target;
+    /**
+     * @brief Next tile to sweep
+     *
+     */
+    int *next;
+    /**
+     * @brief Whether the sweeps are over
+     *
+     */
+    int *done;
+    /**
+     * @brief Lock held while the threads are created, so that they stop before the first sweep if one fails to start
+     *
+     */
+    pthread_mutex_t *gate;
+    /**
+     * @brief Barrier at the start and at the end of each sweep
+     *
+     */
+    pthread_barrier_t *barrier;
+    /**
+     * @brief Maximum change of a Q-value during the last sweep of the thread
+     *
+     */
+    double delta;
+} Sweeper;
+
+/**
+ * @brief Sweep the tiles claimed by a thread until the sweeps are over
+ *
+ * @param arg Sweeper to run
+ * @return void* NULL
+ */
+void *run_sweeper(void *arg);
+
+/**
+ * @brief Compute the Q-table of the map by value iteration on the transition table
+ *
+ * The Q-values are the fixed point of the updates of q(): the reward of the move plus gamma times max_q of the next cell,
+ * for the cells the agent can stand on, so the Q-table is the one training would converge to.
+ * The sweeps stop when no Q-value changes by more than the tolerance, or after -epochs sweeps.
+ *
+ * @param map Map containing the Q-table, used as starting point, its transition table is built if needed
+ * @param params Parameters, with the number of threads and the kind of sweeps
+ * @return int Status
+ */
+int solve_q(Map *map, Params params);
+
+#endif
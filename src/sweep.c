@@ -0,0 +1,523 @@
+/**
+ * @file sweep.c
+ * @author Antoine Qiu
+ * @brief Hyperparameter sweep of the training, running the configurations in parallel
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "q_learning.h"
+#include "params.h"
+#include "train.h"
+#include "convergence.h"
+
+/**
+ * @brief Maximum number of values in a sweep option list, ranges included
+ *
+ */
+#define SWEEP_LIST 64
+
+/**
+ * @brief Names of the modes, the bits of their index are the euclidean and teleporter flags
+ *
+ */
+const char *mode_names[] = {"default", "euclidean", "teleporter", "euclidean-teleporter"};
+
+/**
+ * @brief Structure containing the options of the sweep
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Learning rates
+     *
+     */
+    double alphas[SWEEP_LIST];
+    /**
+     * @brief Number of learning rates
+     *
+     */
+    int alphas_count;
+    /**
+     * @brief Discount factors
+     *
+     */
+    double gammas[SWEEP_LIST];
+    /**
+     * @brief Number of discount factors
+     *
+     */
+    int gammas_count;
+    /**
+     * @brief Exploration rates
+     *
+     */
+    double epsilons[SWEEP_LIST];
+    /**
+     * @brief Number of exploration rates
+     *
+     */
+    int epsilons_count;
+    /**
+     * @brief Modes, indices in mode_names
+     *
+     */
+    int modes[SWEEP_LIST];
+    /**
+     * @brief Number of modes
+     *
+     */
+    int modes_count;
+    /**
+     * @brief Number of seeds of each configuration
+     *
+     */
+    int seeds;
+    /**
+     * @brief First seed, the others follow
+     *
+     */
+    long seed;
+    /**
+     * @brief Maximum number of epochs of a configuration
+     *
+     */
+    int epochs;
+    /**
+     * @brief Tolerance of the convergence
+     *
+     */
+    double tolerance;
+    /**
+     * @brief Number of consecutive converged epochs before stopping
+     *
+     */
+    int patience;
+    /**
+     * @brief Map file, NULL for the default map
+     *
+     */
+    char *map;
+    /**
+     * @brief Number of configurations run at once
+     *
+     */
+    int threads;
+    /**
+     * @brief Output JSON lines instead of CSV
+     *
+     */
+    int json;
+} Sweep;
+
+/**
+ * @brief Structure containing a configuration of the sweep and its result
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Mode, index in mode_names
+     *
+     */
+    int mode;
+    /**
+     * @brief Learning rate
+     *
+     */
+    double alpha;
+    /**
+     * @brief Discount factor
+     *
+     */
+    double gamma;
+    /**
+     * @brief Exploration rate
+     *
+     */
+    double epsilon;
+    /**
+     * @brief Seed of the agent
+     *
+     */
+    long seed;
+    /**
+     * @brief First epoch of the converged streak, -1 if not converged
+     *
+     */
+    int convergence_epoch;
+    /**
+     * @brief Number of epochs run
+     *
+     */
+    int epochs;
+    /**
+     * @brief Length of the greedy path from the start once trained, -1 if it reaches no goal
+     *
+     */
+    int greedy_steps;
+    /**
+     * @brief Duration of the training in seconds
+     *
+     */
+    double time;
+} Config;
+
+/**
+ * @brief Structure representing a sweep thread, the configurations are shared
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Options
+     *
+     */
+    Sweep sweep;
+    /**
+     * @brief All the configurations
+     *
+     */
+    Config *configs;
+    /**
+     * @brief Number of configurations
+     *
+     */
+    int count;
+    /**
+     * @brief Next configuration to run
+     *
+     */
+    int *next;
+} SweepThread;
+
+/**
+ * @brief Get a monotonic time in seconds
+ *
+ * @return double Time
+ */
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Train one configuration from an empty Q-table and record its result
+ *
+ * Each configuration has its own map, Q-table, random generator and running flag, so that any thread can run it.
+ *
+ * @param sweep Options
+ * @param config Configuration
+ */
+void run_config(Sweep sweep, Config *config)
+{
+    Params params = {0};
+    params.epochs = sweep.epochs;
+    params.alpha = config->alpha;
+    params.gamma = config->gamma;
+    params.epsilon = config->epsilon;
+    params.tolerance = sweep.tolerance;
+    params.patience = sweep.patience;
+    params.seed = config->seed;
+    params.euclidean = config->mode & 1;
+    params.teleporter = config->mode >> 1 & 1;
+    params.threads = 1;
+    params.agents = 1;
+
+    Map map;
+    if (sweep.map == NULL ? !build_map(&map, params.teleporter, 0) : !load_map(&map, sweep.map, params.teleporter, 0))
+    {
+        return;
+    }
+    seed_random(&map.random, config->seed);
+
+    int running = 1;
+    Convergence convergence;
+    init_convergence(&convergence);
+    Trainer trainer = {&map, params, &running, NULL, &convergence, NULL, NULL, NULL, NULL, 1};
+    double start = now();
+    run_trainer(&trainer);
+    config->time = now() - start;
+    config->convergence_epoch = convergence.epoch;
+    config->epochs = map.epoch;
+    config->greedy_steps = greedy_path(map, params);
+    free_map(map);
+}
+
+/**
+ * @brief Run the configurations claimed by a thread until none is left
+ *
+ * @param arg Sweep thread
+ * @return void* NULL
+ */
+void *run_sweep_thread(void *arg)
+{
+    SweepThread *thread = arg;
+    for (int i = __atomic_fetch_add(thread->next, 1, __ATOMIC_RELAXED); i < thread->count; i = __atomic_fetch_add(thread->next, 1, __ATOMIC_RELAXED))
+    {
+        run_config(thread->sweep, &thread->configs[i]);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parse a comma-separated list of numbers and of start:stop:step ranges, stop included
+ *
+ * @param text List to parse
+ * @param values Parsed values
+ * @return int Number of values, -1 if a range is invalid or the list too long
+ */
+int parse_range(char *text, double *values)
+{
+    int n = 0;
+    for (char *item = strtok(text, ","); item != NULL; item = strtok(NULL, ","))
+    {
+        double start, stop, step;
+        int fields = sscanf(item, "%lf:%lf:%lf", &start, &stop, &step);
+        if (fields == 1)
+        {
+            stop = start;
+            step = 1;
+        }
+        else if (fields != 3 || step <= 0)
+        {
+            return -1;
+        }
+        // the stop value is reached despite rounding errors on the steps
+        for (int k = 0; start + k * step <= stop + step * 1e-9; k++)
+        {
+            if (n == SWEEP_LIST)
+            {
+                return -1;
+            }
+            values[n++] = start + k * step;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Parse a comma-separated list of modes
+ *
+ * @param text List to parse
+ * @param values Parsed values, indices in mode_names
+ * @return int Number of values, -1 on unknown mode
+ */
+int parse_modes(char *text, int *values)
+{
+    int n = 0;
+    for (char *item = strtok(text, ","); item != NULL && n < SWEEP_LIST; item = strtok(NULL, ","))
+    {
+        int found = -1;
+        for (int i = 0; i < 4; i++)
+        {
+            if (strcmp(item, mode_names[i]) == 0)
+            {
+                found = i;
+            }
+        }
+        if (found < 0)
+        {
+            return -1;
+        }
+        values[n++] = found;
+    }
+    return n;
+}
+
+/**
+ * @brief Print the help of the sweep
+ *
+ */
+void print_sweep_help()
+{
+    printf("Usage: ./sweep [options]\n");
+    printf("Options:\n");
+    printf("-alpha <list> (default: %g) : Learning rates, as values and start:stop:step ranges separated by commas\n", ALPHA);
+    printf("-gamma <list> (default: %g) : Discount factors, as values and ranges\n", GAMMA);
+    printf("-epsilon <list> (default: %g) : Exploration rates, as values and ranges\n", EPSILON);
+    printf("-modes <list> (default: default) : Modes among default,euclidean,teleporter,euclidean-teleporter\n");
+    printf("-seeds <int> (default: 1) : Number of seeds of each configuration\n");
+    printf("-seed <int> (default: 1) : First seed, the others follow\n");
+    printf("-epochs <int> (default: 100000) : Maximum number of epochs of a configuration\n");
+    printf("-tolerance <float> (default: 0.001) : Stop a configuration once no Q-value changes by more than this and no greedy action changes for patience epochs\n");
+    printf("-patience <int> (default: %d) : Number of consecutive converged epochs before stopping\n", PATIENCE);
+    printf("-map <filename> (default: NULL) : Map file instead of the default map\n");
+    printf("-threads <int> (default: number of cores) : Number of configurations run at once\n");
+    printf("-json : Output JSON lines instead of CSV\n");
+    printf("-help : Print the help message\n");
+}
+
+/**
+ * @brief Main function of the sweep
+ *
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return int Status
+ */
+int main(int argc, char **argv)
+{
+    Sweep sweep = {{ALPHA}, 1, {GAMMA}, 1, {EPSILON}, 1, {0}, 1, 1, 1, 100000, 0.001, PATIENCE, NULL, sysconf(_SC_NPROCESSORS_ONLN), 0};
+    for (int i = 1; i < argc; i++)
+    {
+        int status = 0;
+        if (strcmp(argv[i], "-alpha") == 0 && i + 1 < argc)
+        {
+            status = sweep.alphas_count = parse_range(argv[++i], sweep.alphas);
+        }
+        else if (strcmp(argv[i], "-gamma") == 0 && i + 1 < argc)
+        {
+            status = sweep.gammas_count = parse_range(argv[++i], sweep.gammas);
+        }
+        else if (strcmp(argv[i], "-epsilon") == 0 && i + 1 < argc)
+        {
+            status = sweep.epsilons_count = parse_range(argv[++i], sweep.epsilons);
+        }
+        else if (strcmp(argv[i], "-modes") == 0 && i + 1 < argc)
+        {
+            status = sweep.modes_count = parse_modes(argv[++i], sweep.modes);
+        }
+        else if (strcmp(argv[i], "-seeds") == 0 && i + 1 < argc)
+        {
+            status = (sweep.seeds = atoi(argv[++i])) > 0;
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            sweep.seed = atol(argv[++i]);
+            status = 1;
+        }
+        else if (strcmp(argv[i], "-epochs") == 0 && i + 1 < argc)
+        {
+            status = (sweep.epochs = atoi(argv[++i])) > 0;
+        }
+        else if (strcmp(argv[i], "-tolerance") == 0 && i + 1 < argc)
+        {
+            status = (sweep.tolerance = atof(argv[++i])) >= 0;
+        }
+        else if (strcmp(argv[i], "-patience") == 0 && i + 1 < argc)
+        {
+            status = (sweep.patience = atoi(argv[++i])) > 0;
+        }
+        else if (strcmp(argv[i], "-map") == 0 && i + 1 < argc)
+        {
+            sweep.map = argv[++i];
+            status = 1;
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            status = (sweep.threads = atoi(argv[++i])) > 0;
+        }
+        else if (strcmp(argv[i], "-json") == 0)
+        {
+            sweep.json = 1;
+            status = 1;
+        }
+        else if (strcmp(argv[i], "-help") == 0)
+        {
+            print_sweep_help();
+            return 0;
+        }
+        if (status <= 0)
+        {
+            printf("Invalid parameter: %s\n", argv[i]);
+            print_sweep_help();
+            return 1;
+        }
+    }
+
+    // the map is checked once here rather than failing in every configuration
+    Map map;
+    if (sweep.map != NULL && !load_map(&map, sweep.map, 0, 0))
+    {
+        printf("Failed to load map from %s\n", sweep.map);
+        return 1;
+    }
+    if (sweep.map != NULL)
+    {
+        free_map(map);
+    }
+
+    // every combination of the options, in the order of the results table
+    int count = sweep.modes_count * sweep.alphas_count * sweep.gammas_count * sweep.epsilons_count * sweep.seeds;
+    Config *configs = malloc(count * sizeof(Config));
+    if (configs == NULL)
+    {
+        printf("Failed to allocate configurations\n");
+        return 1;
+    }
+    int n = 0;
+    for (int m = 0; m < sweep.modes_count; m++)
+    {
+        for (int a = 0; a < sweep.alphas_count; a++)
+        {
+            for (int g = 0; g < sweep.gammas_count; g++)
+            {
+                for (int e = 0; e < sweep.epsilons_count; e++)
+                {
+                    for (int s = 0; s < sweep.seeds; s++)
+                    {
+                        configs[n++] = (Config){sweep.modes[m], sweep.alphas[a], sweep.gammas[g], sweep.epsilons[e], sweep.seed + s, -1, 0, -1, 0};
+                    }
+                }
+            }
+        }
+    }
+
+    // the threads claim the configurations one at a time, so that long ones do not hold back the others
+    int threads_count = sweep.threads < count ? sweep.threads : count;
+    SweepThread threads[threads_count];
+    pthread_t ids[threads_count];
+    int next = 0;
+    int started = 0;
+    double start = now();
+    for (int i = 0; i < threads_count; i++)
+    {
+        threads[i] = (SweepThread){sweep, configs, count, &next};
+        if (pthread_create(&ids[i], NULL, run_sweep_thread, &threads[i]) != 0)
+        {
+            break;
+        }
+        started++;
+    }
+    // without any thread, the configurations run on the main thread
+    if (started == 0)
+    {
+        SweepThread thread = {sweep, configs, count, &next};
+        run_sweep_thread(&thread);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(ids[i], NULL);
+    }
+    double time = now() - start;
+
+    if (!sweep.json)
+    {
+        printf("mode,alpha,gamma,epsilon,seed,convergence_epoch,epochs,greedy_steps,time_s\n");
+    }
+    for (int i = 0; i < count; i++)
+    {
+        Config config = configs[i];
+        if (sweep.json)
+        {
+            printf("{\"mode\": \"%s\", \"alpha\": %g, \"gamma\": %g, \"epsilon\": %g, \"seed\": %ld, \"convergence_epoch\": %d, \"epochs\": %d, \"greedy_steps\": %d, \"time_s\": %.3f}\n",
+                   mode_names[config.mode], config.alpha, config.gamma, config.epsilon, config.seed, config.convergence_epoch, config.epochs, config.greedy_steps, config.time);
+        }
+        else
+        {
+            printf("%s,%g,%g,%g,%ld,%d,%d,%d,%.3f\n", mode_names[config.mode], config.alpha, config.gamma, config.epsilon, config.seed, config.convergence_epoch,
+                   config.epochs, config.greedy_steps, config.time);
+        }
+    }
+    fprintf(stderr, "%d configurations on %d threads in %.3f s\n", count, started > 0 ? started : 1, time);
+    free(configs);
+    return 0;
+}
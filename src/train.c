@@ -0,0 +1,352 @@
+/**
+ * @file train.c
+ * @author Antoine Qiu
+ * @brief Implementation of the parallel training
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "train.h"
+
+void *run_worker(void *arg)
+{
+    Worker *worker = arg;
+    Map *map = &worker->map;
+
+    while (__atomic_load_n(worker->running, __ATOMIC_RELAXED))
+    {
+        // claim the next epoch
+        int epoch = __atomic_fetch_add(worker->claimed, 1, __ATOMIC_RELAXED);
+        if ((worker->params.epochs >= 0 && epoch >= worker->params.epochs) || __atomic_load_n(worker->converged, __ATOMIC_RELAXED) == worker->params.threads)
+        {
+            break;
+        }
+
+        // run the epoch until a goal is reached
+        map->agent = map->start;
+        map->steps = 0;
+        enum Type type = EMPTY;
+        while (type != GOAL_1 && type != GOAL_2 && __atomic_load_n(worker->running, __ATOMIC_RELAXED))
+        {
+            State next_state = q(map, map->agent, worker->params);
+            if (get_type(*map, next_state) != WALL)
+            {
+                map->agent = next_state;
+            }
+            map->steps++;
+            type = get_type(*map, map->agent);
+        }
+        worker->steps += map->steps;
+        if (type == GOAL_1 || type == GOAL_2)
+        {
+            map->epoch++;
+
+            // a thread can leave the converged ones when the others change the Q-table again
+            if (worker->params.tolerance > 0)
+            {
+                int was_stable = worker->convergence.stable >= worker->params.patience;
+                check_convergence(&worker->convergence, &map->deltas, worker->params, map->epoch, 1);
+                int stable = worker->convergence.stable >= worker->params.patience;
+                if (stable != was_stable)
+                {
+                    __atomic_fetch_add(worker->converged, stable ? 1 : -1, __ATOMIC_RELAXED);
+                }
+            }
+        }
+    }
+
+    __atomic_fetch_sub(worker->active, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int train_parallel(Map *map, Params params, int *running, Checkpoint *checkpoint, Convergence *convergence)
+{
+    Worker *workers = malloc(params.threads * sizeof(Worker));
+    pthread_t *threads = malloc(params.threads * sizeof(pthread_t));
+    if (workers == NULL || threads == NULL)
+    {
+        free(workers);
+        free(threads);
+        return 0;
+    }
+
+    int claimed = (*map).epoch;
+    int active = params.threads;
+    int converged = 0;
+    struct timeval start, now;
+    gettimeofday(&start, NULL);
+
+    // each worker gets its own copy of the map, sharing the Q-table, with an independent random stream
+    for (int i = 0; i < params.threads; i++)
+    {
+        jump_random(&(*map).random);
+        workers[i] = (Worker){*map, params, &claimed, &active, running, &converged, {0}, 0};
+        workers[i].map.epoch = 0;
+        init_convergence(&workers[i].convergence);
+        if (pthread_create(&threads[i], NULL, run_worker, &workers[i]) != 0)
+        {
+            // the threads already started are stopped
+            __atomic_store_n(running, 0, __ATOMIC_RELAXED);
+            for (int j = 0; j < i; j++)
+            {
+                pthread_join(threads[j], NULL);
+            }
+            free(workers);
+            free(threads);
+            return 0;
+        }
+    }
+    jump_random(&(*map).random);
+
+    // print progress every second and take checkpoints while the workers are running
+    int ticks = 0;
+    while (__atomic_load_n(&active, __ATOMIC_ACQUIRE) > 0)
+    {
+        usleep(100000);
+        int current = __atomic_load_n(&claimed, __ATOMIC_RELAXED);
+        if (params.epochs >= 0 && current > params.epochs)
+        {
+            current = params.epochs;
+        }
+        if (params.print && ++ticks % 10 == 0)
+        {
+            printf("Epoch %d/%d\n", current, params.epochs);
+        }
+        if (checkpoint != NULL)
+        {
+            Map snapshot = *map;
+            snapshot.epoch = current;
+            tick_checkpoint(checkpoint, snapshot);
+        }
+    }
+
+    // merge the counters of the workers
+    int epochs = 0;
+    int stable = 0;
+    long steps = 0;
+    for (int i = 0; i < params.threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+        epochs += workers[i].map.epoch;
+        stable += workers[i].convergence.stable;
+        steps += workers[i].steps;
+    }
+    (*map).epoch += epochs;
+
+    // the converged streaks of the threads end together, so they cover the last epochs
+    if (converged == params.threads)
+    {
+        convergence->stable = stable;
+        convergence->epoch = (*map).epoch - stable + 1;
+    }
+    gettimeofday(&now, NULL);
+    double time = (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1e6;
+
+    if (params.print)
+    {
+        printf("%d threads\t%d epochs\t%ld steps\t%.3f s\t%.0f epochs/s\t%.0f steps/s\n", params.threads, epochs, steps, time, epochs / time, steps / time);
+    }
+
+    free(workers);
+    free(threads);
+    return 1;
+}
+
+
+int train_batch(Map *map, Params params, int *running, Checkpoint *checkpoint, Convergence *convergence)
+{
+    Batch batch;
+    if (((*map).transitions == NULL && !build_transitions(map, params)) || !init_batch(&batch, map, params.agents))
+    {
+        return 0;
+    }
+
+    struct timeval start, now;
+    gettimeofday(&start, NULL);
+    int epoch = (*map).epoch;
+    while (__atomic_load_n(running, __ATOMIC_RELAXED) && convergence->epoch < 0 && (params.epochs < 0 || (*map).epoch < params.epochs))
+    {
+        step_batch(map, &batch, params);
+        int finished = epoch + batch.epochs - (*map).epoch;
+        (*map).epoch = epoch + batch.epochs;
+
+        // the updates are checked whenever agents finish epochs
+        if (params.tolerance > 0 && finished > 0)
+        {
+            check_convergence(convergence, &(*map).deltas, params, (*map).epoch, finished);
+        }
+        if (checkpoint != NULL)
+        {
+            tick_checkpoint(checkpoint, *map);
+        }
+    }
+    gettimeofday(&now, NULL);
+    double time = (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1e6;
+
+    if (params.print)
+    {
+        printf("%d agents\t%d epochs\t%ld steps\t%.3f s\t%.0f epochs/s\t%.0f steps/s\n", batch.count, batch.epochs, batch.steps, time, batch.epochs / time, batch.steps / time);
+    }
+
+    free_batch(batch);
+    return 1;
+}
+
+/**
+ * @brief Apply the control messages sent by the GUI
+ *
+ * @param trainer Trainer
+ * @param pause Pause state, toggled
+ * @param slow Slow mode, toggled
+ */
+static void apply_controls(Trainer *trainer, int *pause, int *slow)
+{
+    enum Control control;
+    while (receive_control(trainer->display, &control))
+    {
+        switch (control)
+        {
+        case CONTROL_PAUSE:
+            *pause = !*pause;
+            break;
+        case CONTROL_SLOW:
+            *slow = !*slow;
+            break;
+        case CONTROL_QUIT:
+            __atomic_store_n(trainer->running, 0, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+}
+
+void *run_trainer(void *arg)
+{
+    Trainer *trainer = arg;
+    Map *map = trainer->map;
+    Params params = trainer->params;
+    Convergence *convergence = trainer->convergence;
+    Display *display = trainer->display;
+    Route *route = trainer->route;
+    Policy *policy = trainer->policy;
+    int pause = 0;
+    int slow = params.test;
+    int time = 0;
+    struct timeval start, end;
+    if (!params.test)
+    {
+        gettimeofday(&start, NULL);
+    }
+    trainer->status = 1;
+
+    while (__atomic_load_n(trainer->running, __ATOMIC_RELAXED) && convergence->epoch < 0 && (params.epochs < 0 || (*map).epoch < params.epochs))
+    {
+        if (display != NULL)
+        {
+            apply_controls(trainer, &pause, &slow);
+            if (pause)
+            {
+                usleep(PAUSE_DELAY);
+                continue;
+            }
+        }
+
+        // publish the state to show, every step in slow mode
+        if (display != NULL)
+        {
+            publish_display(display, *map, slow);
+            if (slow)
+            {
+                usleep(SLOW_DELAY);
+            }
+        }
+
+        // get next state, from the compiled policy in test mode
+        State next_state = policy != NULL ? act_policy(map, (*map).agent, policy, params) : q(map, (*map).agent, params);
+        if (get_type(*map, next_state) != WALL)
+        {
+            (*map).agent = next_state;
+        }
+        (*map).steps++;
+
+        // check if goal reached, in loop mode the Q-table of the next waypoint is switched in when the current one is reached
+        enum Type type = get_type(*map, (*map).agent);
+        if (route != NULL ? advance_route(route, map) : type == GOAL_1 || type == GOAL_2)
+        {
+            // epoch duration
+            if (!params.test)
+            {
+                gettimeofday(&end, NULL);
+                time = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+            }
+
+            // the goal reached is shown before the agent goes back to the start
+            if (display != NULL)
+            {
+                publish_display(display, *map, slow);
+                if (slow)
+                {
+                    usleep(SLOW_DELAY);
+                }
+            }
+
+            // reset agent
+            (*map).agent = (*map).start;
+            if (!params.test)
+            {
+                (*map).epoch++;
+                if (params.tolerance > 0)
+                {
+                    check_convergence(convergence, &(*map).deltas, params, (*map).epoch, 1);
+                }
+            }
+            if (trainer->checkpoint != NULL)
+            {
+                tick_checkpoint(trainer->checkpoint, *map);
+            }
+
+            // print epoch info
+            if (params.print)
+            {
+                if (params.test)
+                {
+                    printf("%d steps\n", (*map).steps);
+                }
+                else if (params.tolerance > 0)
+                {
+                    printf("Epoch %d/%d\t%d steps\t%d ms\tmax dQ %g\tmean dQ %g\t%ld greedy changes\n", (*map).epoch, params.epochs, (*map).steps, time, convergence->last.max,
+                           convergence->last.updates > 0 ? convergence->last.sum / convergence->last.updates : 0, convergence->last.changes);
+                }
+                else
+                {
+                    printf("Epoch %d/%d\t%d steps\t%d ms\n", (*map).epoch, params.epochs, (*map).steps, time);
+                }
+            }
+            (*map).steps = 0;
+
+            // health check of the greedy policy from every starting cell, outside the measured epoch time
+            if (trainer->evaluator != NULL && !params.test && (*map).epoch % params.eval_every == 0)
+            {
+                Evaluation evaluation;
+                if (evaluate_q(trainer->evaluator, *map, &evaluation))
+                {
+                    print_evaluation(evaluation, (*map).epoch);
+                }
+            }
+
+            if (!params.test)
+            {
+                gettimeofday(&start, NULL);
+            }
+        }
+    }
+
+    // the GUI stops once the trainer did
+    if (display != NULL)
+    {
+        publish_display(display, *map, 1);
+        __atomic_store_n(&display->done, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file train.h
+ * @author Antoine Qiu
+ * @brief Definition of the parallel training
+ * @date 2023-12-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef TRAIN_H
+#define TRAIN_H
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "q_learning.h"
+#include "batch.h"
+#include "checkpoint.h"
+#include "convergence.h"
+#include "display.h"
+#include "params.h"
+#include "route.h"
+#include "policy.h"
+#include "evaluate.h"
+
+/**
+ * @brief Delay in microseconds of each step in slow mode
+ *
+ */
+#define SLOW_DELAY 100000
+/**
+ * @brief Delay in microseconds between two checks of the control messages while paused
+ *
+ */
+#define PAUSE_DELAY 10000
+
+/**
+ * @brief Structure representing a training thread
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Copy of the shared map, with its own agent, counters and random generator
+     *
+     */
+    Map map;
+    /**
+     * @brief Parameters
+     *
+     */
+    Params params;
+    /**
+     * @brief Number of epochs claimed by all the threads
+     *
+     */
+    int *claimed;
+    /**
+     * @brief Number of threads still running
+     *
+     */
+    int *active;
+    /**
+     * @brief Running state of the program
+     *
+     */
+    int *running;
+    /**
+     * @brief Number of threads whose last epochs converged
+     *
+     */
+    int *converged;
+    /**
+     * @brief Convergence detection over the epochs of the thread
+     *
+     */
+    Convergence convergence;
+    /**
+     * @brief Number of steps done by the thread
+     *
+     */
+    long steps;
+} Worker;
+
+/**
+ * @brief Structure representing the single-agent trainer, run on its own thread when the GUI is shown
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Map trained
+     *
+     */
+    Map *map;
+    /**
+     * @brief Parameters
+     *
+     */
+    Params params;
+    /**
+     * @brief Running state of the program
+     *
+     */
+    int *running;
+    /**
+     * @brief Checkpoint writer, NULL without checkpoints
+     *
+     */
+    Checkpoint *checkpoint;
+    /**
+     * @brief Convergence detection, the training stops once it converged
+     *
+     */
+    Convergence *convergence;
+    /**
+     * @brief Snapshots for the GUI and control messages from it, NULL without GUI
+     *
+     */
+    Display *display;
+    /**
+     * @brief Waypoints of the loop mode with their Q-tables, NULL outside loop mode
+     *
+     */
+    Route *route;
+    /**
+     * @brief Greedy policy compiled for the test mode, NULL to act from the Q-table
+     *
+     */
+    Policy *policy;
+    /**
+     * @brief Evaluation of the greedy policy run every eval_every epochs, NULL without periodic evaluation
+     *
+     */
+    Evaluator *evaluator;
+    /**
+     * @brief Status of the trainer once stopped
+     *
+     */
+    int status;
+} Trainer;
+
+/**
+ * @brief Run training or test epochs with a single agent until the epoch limit is reached, it converged or the program stops
+ *
+ * With a display, a snapshot is published at each frame and the control messages of the GUI are applied between steps:
+ * pause, slow mode (on by default in test mode) and quit.
+ *
+ * @param arg Trainer to run
+ * @return void* NULL
+ */
+void *run_trainer(void *arg);
+/**
+ * @brief Run training epochs on a worker until the epoch limit is reached, all the workers converged or the program stops
+ *
+ * @param arg Worker to run
+ * @return void* NULL
+ */
+void *run_worker(void *arg);
+/**
+ * @brief Train the Q-table with several threads running their own epochs on the shared Q-table without locks
+ *
+ * @param map Map containing the shared Q-table, its epoch counter and random generator are updated at the end
+ * @param params Parameters, with the number of threads
+ * @param running Running state of the program
+ * @param checkpoint Checkpoint writer, NULL without checkpoints
+ * @param convergence Convergence detection, the training stops once every thread converged
+ * @return int Status
+ */
+int train_parallel(Map *map, Params params, int *running, Checkpoint *checkpoint, Convergence *convergence);
+/**
+ * @brief Train the Q-table with a batch of agents stepped together on a single thread
+ *
+ * @param map Map containing the Q-table, its transition table is built if needed
+ * @param params Parameters, with the number of agents
+ * @param running Running state of the program
+ * @param checkpoint Checkpoint writer, NULL without checkpoints
+ * @param convergence Convergence detection, the training stops once it converged
+ * @return int Status
+ */
+int train_batch(Map *map, Params params, int *running, Checkpoint *checkpoint, Convergence *convergence);
+
+#endif